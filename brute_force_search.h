@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <cgv/math/fvec.h>
+#include "parallel.h"
+
+/// return index of the point closest to p among the n given points or size_t(-1) if n is 0, where ties are resolved towards the smaller index;
+/// blocks of points are scanned in parallel and each block computes the squared distances of tiles of points into a small array in a loop the compiler vectorizes before reducing the tile to its minimum
+inline size_t find_closest_point_brute_force(const cgv::vec3* points, size_t n, const cgv::vec3& p, unsigned nr_threads = 0)
+{
+	if (n == 0)
+		return size_t(-1);
+	const size_t tile_size = 256;
+	size_t nr_blocks = get_nr_blocks(n, nr_threads, 16384);
+	std::vector<std::pair<float, size_t> > block_results(nr_blocks);
+	parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		float sqr_dists[tile_size];
+		float best_sqr_dist = std::numeric_limits<float>::max();
+		size_t best_index = b;
+		for (size_t tb = b; tb < e; tb += tile_size) {
+			size_t te = std::min(tb + tile_size, e), m = te - tb;
+			const cgv::vec3* tile = points + tb;
+			for (size_t k = 0; k < m; ++k) {
+				float dx = tile[k][0] - p[0], dy = tile[k][1] - p[1], dz = tile[k][2] - p[2];
+				sqr_dists[k] = dx * dx + dy * dy + dz * dz;
+			}
+			float tile_min = sqr_dists[0];
+			for (size_t k = 1; k < m; ++k)
+				tile_min = std::min(tile_min, sqr_dists[k]);
+			// locate the minimum only in tiles that improve the block result
+			if (tile_min < best_sqr_dist) {
+				best_sqr_dist = tile_min;
+				best_index = tb + size_t(std::find(sqr_dists, sqr_dists + m, tile_min) - sqr_dists);
+			}
+		}
+		block_results[bi] = { best_sqr_dist, best_index };
+	}, nr_threads);
+	std::pair<float, size_t> best = block_results[0];
+	for (size_t bi = 1; bi < nr_blocks; ++bi)
+		if (block_results[bi].first < best.first)
+			best = block_results[bi];
+	return best.second;
+}
+
+/// return index of the point with the smallest positive ray parameter t among the n given points within the cone around the ray origin + t * dir with normalized dir, whose radius is radius + slope * t,
+/// or size_t(-1) if the cone contains no point; blocks of points are scanned in parallel and ties are resolved towards the smaller index
+inline size_t find_first_in_cone_brute_force(const cgv::vec3* points, size_t n, const cgv::vec3& origin, const cgv::vec3& dir, float radius, float slope, unsigned nr_threads = 0)
+{
+	if (n == 0)
+		return size_t(-1);
+	size_t nr_blocks = get_nr_blocks(n, nr_threads, 16384);
+	std::vector<std::pair<float, size_t> > block_results(nr_blocks);
+	parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		float best_t = std::numeric_limits<float>::max();
+		size_t best_index = size_t(-1);
+		for (size_t i = b; i < e; ++i) {
+			cgv::vec3 v = points[i] - origin;
+			float t = dot(v, dir), r = radius + slope * t;
+			if (t > 0 && t < best_t && v.sqr_length() - t * t <= r * r) {
+				best_t = t;
+				best_index = i;
+			}
+		}
+		block_results[bi] = { best_t, best_index };
+	}, nr_threads);
+	std::pair<float, size_t> best = block_results[0];
+	for (size_t bi = 1; bi < nr_blocks; ++bi)
+		if (block_results[bi].first < best.first)
+			best = block_results[bi];
+	return best.second;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "octrees.h"
+#include "parallel.h"
+
+/// set neighbors[i] to the indices of the k points closest to point i excluding i itself in order of increasing distance for all points indexed by the octree T and return the number of half edges;
+/// queries are issued in the order of T's point indices, i.e. leaf by leaf and in morton order for morton code based octrees, such that consecutive queries of a thread visit the same nodes and points;
+/// blocks of queries are pulled by a pool of threads, each of which reuses its own result buffer and writes straight into the neighbor lists of its points
+template <typename index_type>
+size_t build_knn_graph(const octree_base& T, unsigned k, std::vector<std::vector<index_type> >& neighbors, unsigned nr_threads = 0)
+{
+	size_t n = T.get_nr_indexed_points();
+	neighbors.resize(n);
+	size_t nr_blocks = get_nr_blocks(n, nr_threads, 1024);
+	std::vector<size_t> block_nr_half_edges(nr_blocks, 0);
+	parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		std::vector<octree_base::distance_index_pair> knn;
+		knn.reserve(k);
+		for (size_t pi = b; pi < e; ++pi) {
+			octree_base::point_index_type i = T.point_indices[pi];
+			T.find_k_nearest(T.points_ptr[i], k, knn, i);
+			std::vector<index_type>& N = neighbors[i];
+			N.resize(knn.size());
+			for (size_t j = 0; j < knn.size(); ++j)
+				N[j] = index_type(knn[j].second);
+			block_nr_half_edges[bi] += knn.size();
+		}
+	}, nr_threads);
+	size_t nr_half_edges = 0;
+	for (size_t cnt : block_nr_half_edges)
+		nr_half_edges += cnt;
+	return nr_half_edges;
+}
+
+/// add the reverse of each half edge (i,j) whose reverse (j,i) is missing and return the number of added half edges, where the added neighbors of each point are appended in increasing index order;
+/// missing reverse edges are counted per target in parallel, prefix sums give each target a segment of a flat edge array that is filled in parallel, and segments are sorted and appended per target in parallel
+template <typename index_type>
+size_t symmetrize_graph(std::vector<std::vector<index_type> >& neighbors, unsigned nr_threads = 0)
+{
+	size_t n = neighbors.size();
+	auto is_reverse_missing = [&](size_t i, index_type j) {
+		const std::vector<index_type>& Nj = neighbors[j];
+		return std::find(Nj.begin(), Nj.end(), index_type(i)) == Nj.end();
+	};
+	std::vector<std::atomic<uint32_t> > counts(n);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			counts[i].store(0, std::memory_order_relaxed);
+	}, nr_threads);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			for (index_type j : neighbors[i])
+				if (is_reverse_missing(i, j))
+					counts[j].fetch_add(1, std::memory_order_relaxed);
+	}, nr_threads);
+	std::vector<size_t> offsets(n + 1, 0);
+	for (size_t j = 0; j < n; ++j)
+		offsets[j + 1] = offsets[j] + counts[j].load(std::memory_order_relaxed);
+	size_t nr_added = offsets[n];
+	if (nr_added == 0)
+		return 0;
+	// reuse counts as fill cursors per target
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t j = b; j < e; ++j)
+			counts[j].store(0, std::memory_order_relaxed);
+	}, nr_threads);
+	std::vector<index_type> added(nr_added);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			for (index_type j : neighbors[i])
+				if (is_reverse_missing(i, j))
+					added[offsets[j] + counts[j].fetch_add(1, std::memory_order_relaxed)] = index_type(i);
+	}, nr_threads);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t j = b; j < e; ++j) {
+			if (offsets[j] == offsets[j + 1])
+				continue;
+			std::sort(added.begin() + offsets[j], added.begin() + offsets[j + 1]);
+			neighbors[j].insert(neighbors[j].end(), added.begin() + offsets[j], added.begin() + offsets[j + 1]);
+		}
+	}, nr_threads);
+	return nr_added;
+}
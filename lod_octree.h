@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include "octrees.h"
+
+/// view parameters for cut selection given by the rows of the combined projection and modelview matrix and the number of pixels per unit at unit distance
+struct lod_view
+{
+	float mvp[4][4];
+	float pixel_scale;
+	/// set from projection and modelview matrices of any type that provides element access with operator()(i,j)
+	template <typename matrix_type>
+	void set(const matrix_type& projection, const matrix_type& modelview, float viewport_height)
+	{
+		for (unsigned i = 0; i < 4; ++i)
+			for (unsigned j = 0; j < 4; ++j) {
+				double m = 0;
+				for (unsigned k = 0; k < 4; ++k)
+					m += double(projection(i, k)) * double(modelview(k, j));
+				mvp[i][j] = float(m);
+			}
+		pixel_scale = float(projection(1, 1)) * 0.5f * viewport_height;
+	}
+	/// return whether box lies completely outside of one of the six frustum planes
+	bool is_culled(const cgv::box3& box) const
+	{
+		cgv::vec3 center = box.get_center(), half = 0.5f * box.get_extent();
+		for (unsigned i = 0; i < 3; ++i)
+			for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f) {
+				float plane[4];
+				for (unsigned j = 0; j < 4; ++j)
+					plane[j] = mvp[3][j] + sign * mvp[i][j];
+				float dist = plane[3];
+				for (unsigned j = 0; j < 3; ++j)
+					dist += plane[j] * center[j] + std::abs(plane[j]) * half[j];
+				if (dist < 0)
+					return true;
+			}
+		return false;
+	}
+	/// return projected size in pixels of a geometric error for the closest point of box, which is infinite if box reaches behind the eye
+	float project_error(const cgv::box3& box, float geometric_error) const
+	{
+		cgv::vec3 center = box.get_center(), half = 0.5f * box.get_extent();
+		float min_w = mvp[3][3];
+		for (unsigned j = 0; j < 3; ++j)
+			min_w += mvp[3][j] * center[j] - std::abs(mvp[3][j]) * half[j];
+		if (min_w <= 1e-6f)
+			return std::numeric_limits<float>::max();
+		return geometric_error * pixel_scale / min_w;
+	}
+};
+
+/// level of detail hierarchy over an octree, which stores for each node a representative subsample of its points and selects cuts through the tree by projected error and a point budget
+struct point_lod_octree
+{
+	typedef octree_base::node_index_type node_index_type;
+	typedef octree_base::point_index_type point_index_type;
+	typedef octree_base::node_ref node_ref;
+	const octree_base* octree_ptr = 0;
+	/// samples of node ni are stored in samples[sample_offsets[ni], sample_offsets[ni+1]), leaves keep all of their points
+	std::vector<point_index_type> sample_offsets;
+	std::vector<point_index_type> samples;
+	/// entry of the refinement heap ordered by projected error
+	struct cut_entry
+	{
+		node_ref nr;
+		float error;
+		bool operator < (const cut_entry& e) const { return error < e.error; }
+	};
+	std::vector<cut_entry> heap;
+	/// build samples by taking evenly strided points of each node, which are spatially stratified as points are sorted along the octree
+	void build(const octree_base& octree, point_index_type nr_samples_per_node, unsigned nr_threads = 0)
+	{
+		octree_ptr = &octree;
+		node_index_type nr_nodes = octree.get_nr_nodes();
+		sample_offsets.resize(nr_nodes + 1);
+		sample_offsets[0] = 0;
+		for (node_index_type ni = 0; ni < nr_nodes; ++ni)
+			sample_offsets[ni + 1] = sample_offsets[ni] + (octree.is_leaf(ni) ? octree.get_nr_points(ni) : std::min(octree.get_nr_points(ni), nr_samples_per_node));
+		samples.resize(sample_offsets[nr_nodes]);
+		parallel_for(0, nr_nodes, [&](size_t begin, size_t end) {
+			for (size_t ni = begin; ni < end; ++ni) {
+				uint64_t nr_points = octree.get_nr_points(node_index_type(ni)), first_point = octree.get_first_point(node_index_type(ni));
+				uint64_t nr_samples = get_nr_samples(node_index_type(ni));
+				for (uint64_t i = 0; i < nr_samples; ++i)
+					samples[sample_offsets[ni] + i] = octree.point_indices[first_point + i * nr_points / nr_samples];
+			}
+		}, nr_threads, 256);
+	}
+	void clear()
+	{
+		octree_ptr = 0;
+		sample_offsets.clear();
+		samples.clear();
+	}
+	bool empty() const { return octree_ptr == 0 || samples.empty(); }
+	point_index_type get_nr_samples(node_index_type ni) const { return sample_offsets[ni + 1] - sample_offsets[ni]; }
+	const point_index_type* get_samples(node_index_type ni) const { return &samples[sample_offsets[ni]]; }
+	/// return approximate spacing of the samples of a node, where leaves are exact
+	float get_geometric_error(const node_ref& nr) const
+	{
+		if (octree_ptr->is_leaf(nr.node_index))
+			return 0.0f;
+		return nr.box.get_extent().length() / std::sqrt(float(std::max(get_nr_samples(nr.node_index), point_index_type(1))));
+	}
+	/// select cut by refining the node of largest projected error until all errors are below max_screen_error or no refinement fits into the point budget; nodes outside of the view frustum are culled; returns number of points in cut
+	size_t select_cut(const lod_view& view, float max_screen_error, size_t point_budget, std::vector<node_index_type>& cut)
+	{
+		cut.clear();
+		heap.clear();
+		if (empty())
+			return 0;
+		node_ref root = octree_ptr->get_root_ref();
+		if (view.is_culled(root.box))
+			return 0;
+		heap.push_back({ root, view.project_error(root.box, get_geometric_error(root)) });
+		size_t nr_points = get_nr_samples(root.node_index);
+		cut_entry children[8];
+		while (!heap.empty() && heap.front().error > max_screen_error) {
+			std::pop_heap(heap.begin(), heap.end());
+			cut_entry e = heap.back();
+			heap.pop_back();
+			unsigned nr_children = 0;
+			size_t nr_child_points = 0;
+			for (const auto& child : octree_ptr->children(e.nr)) {
+				if (view.is_culled(child.box))
+					continue;
+				children[nr_children++] = { child, view.project_error(child.box, get_geometric_error(child)) };
+				nr_child_points += get_nr_samples(child.node_index);
+			}
+			// keep node in cut if it is a leaf or its refinement exceeds the budget
+			if (octree_ptr->is_leaf(e.nr.node_index) || nr_points + nr_child_points > point_budget + get_nr_samples(e.nr.node_index)) {
+				cut.push_back(e.nr.node_index);
+				continue;
+			}
+			nr_points = nr_points + nr_child_points - get_nr_samples(e.nr.node_index);
+			for (unsigned i = 0; i < nr_children; ++i) {
+				heap.push_back(children[i]);
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+		for (const auto& e : heap)
+			cut.push_back(e.nr.node_index);
+		return nr_points;
+	}
+};
@@ -0,0 +1,115 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static const intptr_t invalid_handle = intptr_t(INVALID_HANDLE_VALUE);
+#else
+static const intptr_t invalid_handle = -1;
+#endif
+
+mapped_file::mapped_file() : file_handle(invalid_handle), mapping_handle(invalid_handle), file_size(0)
+{
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+bool mapped_file::open(const std::string& file_name)
+{
+	close();
+#ifdef _WIN32
+	HANDLE fh = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (fh == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fh, &size) || size.QuadPart == 0) {
+		CloseHandle(fh);
+		return false;
+	}
+	HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mh == NULL) {
+		CloseHandle(fh);
+		return false;
+	}
+	file_handle = intptr_t(fh);
+	mapping_handle = intptr_t(mh);
+	file_size = uint64_t(size.QuadPart);
+#else
+	int fd = ::open(file_name.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	file_handle = fd;
+	file_size = uint64_t(st.st_size);
+#endif
+	return true;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+	if (mapping_handle != invalid_handle)
+		CloseHandle(HANDLE(mapping_handle));
+	if (file_handle != invalid_handle)
+		CloseHandle(HANDLE(file_handle));
+#else
+	if (file_handle != invalid_handle)
+		::close(int(file_handle));
+#endif
+	file_handle = mapping_handle = invalid_handle;
+	file_size = 0;
+}
+
+bool mapped_file::is_open() const
+{
+	return file_handle != invalid_handle;
+}
+
+size_t mapped_file::get_allocation_granularity()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return size_t(info.dwAllocationGranularity);
+#else
+	return size_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+const char* mapped_file::map_view(uint64_t offset, size_t size)
+{
+	if (!is_open() || offset + size > file_size)
+		return 0;
+#ifdef _WIN32
+	void* data = MapViewOfFile(HANDLE(mapping_handle), FILE_MAP_READ, DWORD(offset >> 32), DWORD(offset & 0xFFFFFFFF), size);
+	return reinterpret_cast<const char*>(data);
+#else
+	void* data = mmap(0, size, PROT_READ, MAP_PRIVATE, int(file_handle), off_t(offset));
+	return data == MAP_FAILED ? 0 : reinterpret_cast<const char*>(data);
+#endif
+}
+
+void mapped_file::unmap_view(const char* data, size_t size)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap(const_cast<char*>(data), size);
+#endif
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "lib_begin.h"
+
+/// read only file whose content is accessed through memory mapped views, such that the operating system pages data in on demand
+class CGV_API mapped_file
+{
+protected:
+	/// platform specific file and mapping handles
+	intptr_t file_handle;
+	intptr_t mapping_handle;
+	uint64_t file_size;
+public:
+	mapped_file();
+	~mapped_file();
+	/// open file for mapping and return whether this succeeded
+	bool open(const std::string& file_name);
+	void close();
+	bool is_open() const;
+	uint64_t get_size() const { return file_size; }
+	/// return the granularity that offsets of mapped views need to be aligned to
+	static size_t get_allocation_granularity();
+	/// map size bytes starting at offset, which needs to be a multiple of the allocation granularity; returns 0 on failure
+	const char* map_view(uint64_t offset, size_t size);
+	/// unmap a view returned by map_view
+	void unmap_view(const char* data, size_t size);
+};
+
+#include <cgv/config/lib_end.h>
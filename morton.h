@@ -1,5 +1,29 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#	define MORTON_X86
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#	include <immintrin.h>
+#endif
+
+#if defined(MORTON_X86) && (defined(__GNUC__) || defined(__clang__))
+#	define MORTON_TARGET(FEATURES) __attribute__((target(FEATURES)))
+#else
+#	define MORTON_TARGET(FEATURES)
+#endif
+
 /// this code has been extracted from https://github.com/Forceflow/libmorton
 
 #define EIGHTBITMASK (morton) 0x000000FF
@@ -255,3 +279,262 @@ inline uint_fast64_t morton3D_64_encode(const uint_fast32_t x, const uint_fast32
 inline void morton3D_64_decode(const uint_fast64_t morton, uint_fast32_t& x, uint_fast32_t& y, uint_fast32_t& z) {
 	m3D_d_sLUT<uint_fast64_t, uint_fast32_t>(morton, x, y, z);
 }
+
+/// the batch kernels below encode and decode 21 bit coordinates, with x in bit 0, y in bit 1 and z in bit 2 of each 3 bit group
+enum MortonBackend {
+	MB_LUT,
+	MB_MAGIC_BITS,
+	MB_BMI2,
+	MB_AVX2,
+	MB_AUTO
+};
+inline const char* get_morton_backend_name(MortonBackend backend) {
+	static const char* names[] = { "lut", "magic bits", "bmi2", "avx2", "auto" };
+	return names[backend];
+}
+/// check whether the executing cpu supports the given backend
+inline bool morton_backend_supported(MortonBackend backend) {
+	switch (backend) {
+	case MB_LUT:
+	case MB_MAGIC_BITS:
+	case MB_AUTO:
+		return true;
+#ifdef MORTON_X86
+#	ifdef _MSC_VER
+	case MB_BMI2:
+	case MB_AVX2: {
+		int regs[4];
+		__cpuid(regs, 0);
+		if (regs[0] < 7)
+			return false;
+		__cpuidex(regs, 7, 0);
+		if (backend == MB_BMI2)
+#		ifdef _M_X64
+			return (regs[1] & (1 << 8)) != 0;
+#		else
+			return false;
+#		endif
+		if ((regs[1] & (1 << 5)) == 0)
+			return false;
+		// avx2 additionally requires the os to save ymm registers
+		__cpuid(regs, 1);
+		if ((regs[2] & (1 << 27)) == 0)
+			return false;
+		return (_xgetbv(0) & 6) == 6;
+	}
+#	else
+	case MB_BMI2:
+#		ifndef __x86_64__
+		return false;
+#		endif
+		return __builtin_cpu_supports("bmi2") != 0;
+	case MB_AVX2:
+		return __builtin_cpu_supports("avx2") != 0;
+#	endif
+#endif
+	default:
+		return false;
+	}
+}
+/// check for amd cpus before zen 3, which implement pdep and pext in slow microcode
+inline bool morton_has_slow_pdep() {
+#ifdef MORTON_X86
+	unsigned regs[4] = { 0, 0, 0, 0 };
+#	ifdef _MSC_VER
+	__cpuid(reinterpret_cast<int*>(regs), 0);
+#	else
+	__get_cpuid(0, &regs[0], &regs[1], &regs[2], &regs[3]);
+#	endif
+	// vendor string "AuthenticAMD" is stored in ebx, edx, ecx
+	if (regs[1] != 0x68747541 || regs[3] != 0x69746e65 || regs[2] != 0x444d4163)
+		return false;
+#	ifdef _MSC_VER
+	__cpuid(reinterpret_cast<int*>(regs), 1);
+#	else
+	__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#	endif
+	unsigned family = ((regs[0] >> 8) & 15) + ((regs[0] >> 20) & 255);
+	return family < 0x19;
+#else
+	return false;
+#endif
+}
+/// return fastest supported backend, determined once from cpuid
+inline MortonBackend get_best_morton_backend() {
+	static const MortonBackend best_backend =
+		(morton_backend_supported(MB_BMI2) && !morton_has_slow_pdep()) ? MB_BMI2 :
+		(morton_backend_supported(MB_AVX2) ? MB_AVX2 : MB_MAGIC_BITS);
+	return best_backend;
+}
+// spread lower 21 bits of x to every third bit
+inline uint64_t morton3D_64_split_by_3(uint64_t x) {
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffull;
+	x = (x | x << 16) & 0x1f0000ff0000ffull;
+	x = (x | x << 8) & 0x100f00f00f00f00full;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+	x = (x | x << 2) & 0x1249249249249249ull;
+	return x;
+}
+// gather every third bit of m into lower 21 bits
+inline uint32_t morton3D_64_compact_by_3(uint64_t m) {
+	m &= 0x1249249249249249ull;
+	m = (m ^ (m >> 2)) & 0x10c30c30c30c30c3ull;
+	m = (m ^ (m >> 4)) & 0x100f00f00f00f00full;
+	m = (m ^ (m >> 8)) & 0x1f0000ff0000ffull;
+	m = (m ^ (m >> 16)) & 0x1f00000000ffffull;
+	m = (m ^ (m >> 32)) & 0x1fffff;
+	return uint32_t(m);
+}
+inline void morton3D_64_encode_batch_lut(const uint32_t* xyz, uint64_t* m, size_t n) {
+	for (size_t i = 0; i < n; ++i, xyz += 3)
+		m[i] = morton3D_64_encode(xyz[0], xyz[1], xyz[2]);
+}
+inline void morton3D_64_decode_batch_lut(const uint64_t* m, uint32_t* xyz, size_t n) {
+	uint_fast32_t x, y, z;
+	for (size_t i = 0; i < n; ++i, xyz += 3) {
+		morton3D_64_decode(m[i], x, y, z);
+		xyz[0] = uint32_t(x);
+		xyz[1] = uint32_t(y);
+		xyz[2] = uint32_t(z);
+	}
+}
+inline void morton3D_64_encode_batch_magic_bits(const uint32_t* xyz, uint64_t* m, size_t n) {
+	for (size_t i = 0; i < n; ++i, xyz += 3)
+		m[i] = morton3D_64_split_by_3(xyz[0]) | (morton3D_64_split_by_3(xyz[1]) << 1) | (morton3D_64_split_by_3(xyz[2]) << 2);
+}
+inline void morton3D_64_decode_batch_magic_bits(const uint64_t* m, uint32_t* xyz, size_t n) {
+	for (size_t i = 0; i < n; ++i, xyz += 3) {
+		xyz[0] = morton3D_64_compact_by_3(m[i]);
+		xyz[1] = morton3D_64_compact_by_3(m[i] >> 1);
+		xyz[2] = morton3D_64_compact_by_3(m[i] >> 2);
+	}
+}
+#ifdef MORTON_X86
+#	if defined(_M_X64) || defined(__x86_64__)
+MORTON_TARGET("bmi2") inline void morton3D_64_encode_batch_bmi2(const uint32_t* xyz, uint64_t* m, size_t n) {
+	for (size_t i = 0; i < n; ++i, xyz += 3)
+		m[i] = _pdep_u64(xyz[0], 0x1249249249249249ull) | _pdep_u64(xyz[1], 0x2492492492492492ull) | _pdep_u64(xyz[2], 0x4924924924924924ull);
+}
+MORTON_TARGET("bmi2") inline void morton3D_64_decode_batch_bmi2(const uint64_t* m, uint32_t* xyz, size_t n) {
+	for (size_t i = 0; i < n; ++i, xyz += 3) {
+		xyz[0] = uint32_t(_pext_u64(m[i], 0x1249249249249249ull));
+		xyz[1] = uint32_t(_pext_u64(m[i], 0x2492492492492492ull));
+		xyz[2] = uint32_t(_pext_u64(m[i], 0x4924924924924924ull));
+	}
+}
+#	endif
+// magic bits on four 64 bit lanes
+MORTON_TARGET("avx2") inline __m256i morton3D_64_split_by_3_avx2(__m256i x) {
+	x = _mm256_and_si256(x, _mm256_set1_epi64x(0x1fffff));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 32)), _mm256_set1_epi64x(0x1f00000000ffffll));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 16)), _mm256_set1_epi64x(0x1f0000ff0000ffll));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 8)), _mm256_set1_epi64x(0x100f00f00f00f00fll));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 4)), _mm256_set1_epi64x(0x10c30c30c30c30c3ll));
+	x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 2)), _mm256_set1_epi64x(0x1249249249249249ll));
+	return x;
+}
+MORTON_TARGET("avx2") inline __m256i morton3D_64_compact_by_3_avx2(__m256i m) {
+	m = _mm256_and_si256(m, _mm256_set1_epi64x(0x1249249249249249ll));
+	m = _mm256_and_si256(_mm256_xor_si256(m, _mm256_srli_epi64(m, 2)), _mm256_set1_epi64x(0x10c30c30c30c30c3ll));
+	m = _mm256_and_si256(_mm256_xor_si256(m, _mm256_srli_epi64(m, 4)), _mm256_set1_epi64x(0x100f00f00f00f00fll));
+	m = _mm256_and_si256(_mm256_xor_si256(m, _mm256_srli_epi64(m, 8)), _mm256_set1_epi64x(0x1f0000ff0000ffll));
+	m = _mm256_and_si256(_mm256_xor_si256(m, _mm256_srli_epi64(m, 16)), _mm256_set1_epi64x(0x1f00000000ffffll));
+	m = _mm256_and_si256(_mm256_xor_si256(m, _mm256_srli_epi64(m, 32)), _mm256_set1_epi64x(0x1fffff));
+	return m;
+}
+MORTON_TARGET("avx2") inline void morton3D_64_encode_batch_avx2(const uint32_t* xyz, uint64_t* m, size_t n) {
+	const __m128i stride = _mm_setr_epi32(0, 3, 6, 9);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4, xyz += 12) {
+		__m256i x = _mm256_cvtepu32_epi64(_mm_i32gather_epi32(reinterpret_cast<const int*>(xyz), stride, 4));
+		__m256i y = _mm256_cvtepu32_epi64(_mm_i32gather_epi32(reinterpret_cast<const int*>(xyz + 1), stride, 4));
+		__m256i z = _mm256_cvtepu32_epi64(_mm_i32gather_epi32(reinterpret_cast<const int*>(xyz + 2), stride, 4));
+		__m256i r = _mm256_or_si256(morton3D_64_split_by_3_avx2(x),
+			_mm256_or_si256(_mm256_slli_epi64(morton3D_64_split_by_3_avx2(y), 1), _mm256_slli_epi64(morton3D_64_split_by_3_avx2(z), 2)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(m + i), r);
+	}
+	morton3D_64_encode_batch_magic_bits(xyz, m + i, n - i);
+}
+MORTON_TARGET("avx2") inline void morton3D_64_decode_batch_avx2(const uint64_t* m, uint32_t* xyz, size_t n) {
+	size_t i = 0;
+	uint32_t lanes[3][8];
+	for (; i + 4 <= n; i += 4, xyz += 12) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[0]), morton3D_64_compact_by_3_avx2(v));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[1]), morton3D_64_compact_by_3_avx2(_mm256_srli_epi64(v, 1)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes[2]), morton3D_64_compact_by_3_avx2(_mm256_srli_epi64(v, 2)));
+		for (unsigned j = 0; j < 4; ++j)
+			for (unsigned c = 0; c < 3; ++c)
+				xyz[3 * j + c] = lanes[c][2 * j];
+	}
+	morton3D_64_decode_batch_magic_bits(m + i, xyz, n - i);
+}
+#endif
+/// encode n coordinate triples stored interleaved in xyz; unsupported backends fall back to the lookup tables
+inline void morton3D_64_encode_batch(const uint32_t* xyz, uint64_t* m, size_t n, MortonBackend backend = MB_AUTO) {
+	if (backend == MB_AUTO)
+		backend = get_best_morton_backend();
+	else if (!morton_backend_supported(backend))
+		backend = MB_LUT;
+	switch (backend) {
+	case MB_MAGIC_BITS: morton3D_64_encode_batch_magic_bits(xyz, m, n); break;
+#if defined(_M_X64) || defined(__x86_64__)
+	case MB_BMI2: morton3D_64_encode_batch_bmi2(xyz, m, n); break;
+#endif
+#ifdef MORTON_X86
+	case MB_AVX2: morton3D_64_encode_batch_avx2(xyz, m, n); break;
+#endif
+	default: morton3D_64_encode_batch_lut(xyz, m, n); break;
+	}
+}
+/// decode n morton codes to interleaved coordinate triples
+inline void morton3D_64_decode_batch(const uint64_t* m, uint32_t* xyz, size_t n, MortonBackend backend = MB_AUTO) {
+	if (backend == MB_AUTO)
+		backend = get_best_morton_backend();
+	else if (!morton_backend_supported(backend))
+		backend = MB_LUT;
+	switch (backend) {
+	case MB_MAGIC_BITS: morton3D_64_decode_batch_magic_bits(m, xyz, n); break;
+#if defined(_M_X64) || defined(__x86_64__)
+	case MB_BMI2: morton3D_64_decode_batch_bmi2(m, xyz, n); break;
+#endif
+#ifdef MORTON_X86
+	case MB_AVX2: morton3D_64_decode_batch_avx2(m, xyz, n); break;
+#endif
+	default: morton3D_64_decode_batch_lut(m, xyz, n); break;
+	}
+}
+/// time encoding and decoding of nr_points random coordinates with all supported backends and check results against the lookup tables; large counts are processed in chunks of at most 2^24 points
+inline void benchmark_morton_kernels(std::ostream& os, size_t nr_points) {
+	size_t chunk_size = nr_points < (size_t(1) << 24) ? nr_points : (size_t(1) << 24);
+	std::vector<uint32_t> xyz(3 * chunk_size), decoded(3 * chunk_size);
+	std::vector<uint64_t> codes(chunk_size), reference(chunk_size);
+	std::default_random_engine E;
+	std::uniform_int_distribution<uint32_t> D(0, (1u << 21) - 1);
+	for (auto& c : xyz)
+		c = D(E);
+	morton3D_64_encode_batch(xyz.data(), reference.data(), chunk_size, MB_LUT);
+	os << "morton kernels on " << nr_points << " points:" << std::endl;
+	for (int bi = MB_LUT; bi < MB_AUTO; ++bi) {
+		MortonBackend backend = MortonBackend(bi);
+		if (!morton_backend_supported(backend))
+			continue;
+		double encode_time = 0, decode_time = 0;
+		for (size_t offset = 0; offset < nr_points; offset += chunk_size) {
+			size_t n = nr_points - offset < chunk_size ? nr_points - offset : chunk_size;
+			auto start = std::chrono::steady_clock::now();
+			morton3D_64_encode_batch(xyz.data(), codes.data(), n, backend);
+			auto middle = std::chrono::steady_clock::now();
+			morton3D_64_decode_batch(codes.data(), decoded.data(), n, backend);
+			auto stop = std::chrono::steady_clock::now();
+			encode_time += std::chrono::duration<double>(middle - start).count();
+			decode_time += std::chrono::duration<double>(stop - middle).count();
+		}
+		size_t n = nr_points < chunk_size ? nr_points : chunk_size;
+		bool correct = std::equal(codes.begin(), codes.begin() + n, reference.begin()) && std::equal(decoded.begin(), decoded.begin() + 3 * n, xyz.begin());
+		os << "  " << get_morton_backend_name(backend) << (backend == get_best_morton_backend() ? " (auto)" : "")
+			<< ": encode " << 1e-6 * nr_points / encode_time << " MPoints/sec, decode " << 1e-6 * nr_points / decode_time << " MPoints/sec"
+			<< (correct ? "" : " - MISMATCH") << std::endl;
+	}
+}
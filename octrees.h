@@ -2,7 +2,12 @@
 
 #include <cgv/math/fvec.h>
 #include <cgv/media/axis_aligned_box.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <numeric>
+#include "morton.h"
+#include "parallel.h"
 
 static const uint32_t child_mask_to_nr_children[16] = {
 	0, 1, 1, 2, 1, 2, 2, 3,
@@ -15,19 +20,56 @@ struct octree_base
 	typedef uint32_t point_index_type;
 	typedef void* node_handle;
 	static const node_index_type invalid_node_index = node_index_type(-1);
+	/// maximum number of subdivision levels, limited by the 63 bits of a 64 bit morton code
+	static const unsigned max_depth = 21;
 	cgv::box3 domain;
 	node_index_type root_node_index = 0;
 	std::vector<uint32_t> point_indices;
+	/// points over which the octree has been constructed, which must stay valid for spatial queries
+	const cgv::vec3* points_ptr = 0;
+	virtual ~octree_base() {}
+	/// number of threads used during construction, where 1 constructs sequentially and 0 uses all hardware threads
+	unsigned nr_threads = 1;
+	/// return the level at which construction is split into subtrees that are built as independent tasks
+	unsigned get_task_level() const {
+		unsigned nr_tasks = 4 * get_nr_threads(nr_threads), level = 1;
+		while ((1u << (3 * level)) < nr_tasks && level < max_depth)
+			++level;
+		return level;
+	}
+	/// maximum number of points per leaf and isotropy of the domain given on construction, which are maintained when points are inserted
+	uint32_t max_nr_points_per_leaf = 0;
+	bool ensure_isotropic = true;
+	/// return bounding box of the points in [begin, end) computed in parallel
+	cgv::box3 compute_bounding_box(const cgv::vec3* points_ptr, point_index_type begin, point_index_type end) const {
+		size_t nr_blocks = get_nr_blocks(end - begin, nr_threads);
+		std::vector<cgv::box3> block_domains(nr_blocks);
+		parallel_blocks(begin, end, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+			block_domains[bi].invalidate();
+			for (size_t pi = b; pi < e; ++pi)
+				block_domains[bi].add_point(points_ptr[pi]);
+		}, nr_threads);
+		cgv::box3 B;
+		B.invalidate();
+		for (const auto& block_domain : block_domains)
+			B.add_axis_aligned_box(block_domain);
+		return B;
+	}
+	/// extend the smaller extents of B to its largest extent
+	static void make_isotropic(cgv::box3& B) {
+		unsigned i = B.get_max_extent_coord_index(), j = (i + 1) % 3, k = (i + 2) % 3;
+		float a = B.get_extent()[i];
+		B.ref_max_pnt()[j] = B.ref_min_pnt()[j] + a;
+		B.ref_max_pnt()[k] = B.ref_min_pnt()[k] + a;
+	}
 	void compute_domain(const cgv::vec3* points_ptr, point_index_type nr_points, bool ensure_isotropic = true) {
-		domain.invalidate();
-		for (point_index_type pi=0; pi < nr_points; ++pi)
-			domain.add_point(points_ptr[pi]);
-		if (ensure_isotropic) {
-			unsigned i = domain.get_max_extent_coord_index(), j = (i + 1) % 3, k = (i + 2) % 3;
-			float a = domain.get_extent()[i];
-			domain.ref_max_pnt()[j] = domain.ref_min_pnt()[j] + a;
-			domain.ref_max_pnt()[k] = domain.ref_min_pnt()[k] + a;
-		}
+		domain = compute_bounding_box(points_ptr, 0, nr_points);
+		if (ensure_isotropic)
+			make_isotropic(domain);
+	}
+	/// return child index of point p in a node with the given center
+	static unsigned get_child_index(const cgv::vec3& p, const cgv::vec3& center) {
+		return (p[0] > center[0] ? 1 : 0) + (p[1] > center[1] ? 2 : 0) + (p[2] > center[2] ? 4 : 0);
 	}
 
 	void distribute_points_on_children(std::vector<uint32_t>(&child_point_indices)[8],
@@ -36,14 +78,44 @@ struct octree_base
 	{
 		cgv::vec3 center = B.get_center();
 		for (auto iter = begin; iter != end; ++iter) {
-			const cgv::vec3& point = points_ptr[*iter];
-			uint8_t child_index =
-				(point[0] > center[0] ? 1 : 0) +
-				(point[1] > center[1] ? 2 : 0) +
-				(point[2] > center[2] ? 4 : 0);
-			child_point_indices[child_index].emplace_back(*iter);
+			child_point_indices[get_child_index(points_ptr[*iter], center)].emplace_back(*iter);
 		}
 	}
+	/// distribute points on children in parallel by a stable counting sort of the child indices, which yields the same order as the sequential distribution
+	void parallel_distribute_points_on_children(std::vector<uint32_t>::iterator(&child_begin)[9],
+		const cgv::box3& B, std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end,
+		const cgv::vec3* points_ptr)
+	{
+		cgv::vec3 center = B.get_center();
+		size_t n = end - begin, nr_blocks = get_nr_blocks(n, nr_threads);
+		std::vector<uint8_t> child_indices(n);
+		std::vector<size_t> block_offsets(8 * nr_blocks, 0);
+		parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				uint8_t child_index = uint8_t(get_child_index(points_ptr[begin[i]], center));
+				child_indices[i] = child_index;
+				++block_offsets[8 * bi + child_index];
+			}
+		}, nr_threads);
+		size_t offset = 0;
+		for (unsigned ci = 0; ci < 8; ++ci) {
+			child_begin[ci] = begin + offset;
+			for (size_t bi = 0; bi < nr_blocks; ++bi) {
+				size_t count = block_offsets[8 * bi + ci];
+				block_offsets[8 * bi + ci] = offset;
+				offset += count;
+			}
+		}
+		child_begin[8] = end;
+		std::vector<uint32_t> reordered_point_indices(n);
+		parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i)
+				reordered_point_indices[block_offsets[8 * bi + child_indices[i]]++] = begin[i];
+		}, nr_threads);
+		parallel_for(0, n, [&](size_t b, size_t e) {
+			std::copy(reordered_point_indices.begin() + b, reordered_point_indices.begin() + e, begin + b);
+		}, nr_threads);
+	}
 	void reorder_indices_to_children(std::vector<uint32_t>::iterator(&child_begin)[9],
 		const std::vector<uint32_t>(&child_point_indices)[8], std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end)
 	{
@@ -54,7 +126,7 @@ struct octree_base
 		}
 		child_begin[8] = end;
 	}
-	cgv::box3 child_box(const cgv::box3& B, unsigned ci) const
+	static cgv::box3 child_box(const cgv::box3& B, unsigned ci)
 	{
 		cgv::vec3 center = B.get_center();
 		return cgv::box3(
@@ -70,202 +142,908 @@ struct octree_base
 			));
 	}
 
-	virtual void construct(const cgv::vec3* points_ptr, point_index_type nr_points, uint32_t max_nr_points_per_leaf, bool ensure_isotropic) = 0;
+	/// construct octree over the given points within the current domain
+	virtual void construct_in_domain(const cgv::vec3* points_ptr, point_index_type nr_points, uint32_t max_nr_points_per_leaf) = 0;
+	/// insert points [begin, end) into the existing nodes, where all points must lie inside of the domain
+	virtual void insert_points_in_domain(point_index_type begin, point_index_type end) = 0;
+	void construct(const cgv::vec3* points_ptr, point_index_type nr_points, uint32_t max_nr_points_per_leaf, bool ensure_isotropic)
+	{
+		this->max_nr_points_per_leaf = max_nr_points_per_leaf;
+		this->ensure_isotropic = ensure_isotropic;
+		compute_domain(points_ptr, nr_points, ensure_isotropic);
+		construct_in_domain(points_ptr, nr_points, max_nr_points_per_leaf);
+	}
+	/// return number of points covered by the octree
+	point_index_type get_nr_indexed_points() const { return point_index_type(point_indices.size()); }
+	/// insert the points that have been appended behind the indexed points, such that the octree covers the first nr_points points afterwards; the points may have been reallocated.
+	/// Leaves that overflow are subdivided locally. Only if new points fall outside of the domain, the octree is rebuilt over a domain of twice the extent of the union with the new points, such that appends that extend the scene trigger a logarithmic number of rebuilds.
+	void insert_points(const cgv::vec3* points_ptr, point_index_type nr_points)
+	{
+		this->points_ptr = points_ptr;
+		point_index_type begin = get_nr_indexed_points();
+		if (nr_points <= begin)
+			return;
+		if (begin == 0) {
+			construct(points_ptr, nr_points, max_nr_points_per_leaf, ensure_isotropic);
+			return;
+		}
+		cgv::box3 B = compute_bounding_box(points_ptr, begin, nr_points);
+		bool inside_domain = true;
+		for (unsigned c = 0; c < 3; ++c)
+			if (B.get_min_pnt()[c] < domain.get_min_pnt()[c] || B.get_max_pnt()[c] > domain.get_max_pnt()[c])
+				inside_domain = false;
+		if (inside_domain) {
+			insert_points_in_domain(begin, nr_points);
+			return;
+		}
+		B.add_axis_aligned_box(domain);
+		if (ensure_isotropic)
+			make_isotropic(B);
+		cgv::vec3 center = B.get_center(), extent = B.get_extent();
+		domain = cgv::box3(center - extent, center + extent);
+		construct_in_domain(points_ptr, nr_points, max_nr_points_per_leaf);
+	}
+	/// sort the new points [begin, end) stably by the leaves they fall into; the new points of leaf ni are new_points[leaf_offsets[ni], leaf_offsets[ni+1])
+	static void bucket_points_by_leaf(const std::vector<node_index_type>& point_leaves, point_index_type begin, node_index_type nr_nodes,
+		std::vector<point_index_type>& leaf_offsets, std::vector<point_index_type>& new_points)
+	{
+		leaf_offsets.assign(nr_nodes + 1, 0);
+		for (node_index_type ni : point_leaves)
+			++leaf_offsets[ni + 1];
+		std::partial_sum(leaf_offsets.begin(), leaf_offsets.end(), leaf_offsets.begin());
+		std::vector<point_index_type> offsets(leaf_offsets.begin(), leaf_offsets.end() - 1);
+		new_points.resize(point_leaves.size());
+		for (size_t i = 0; i < point_leaves.size(); ++i)
+			new_points[offsets[point_leaves[i]]++] = begin + point_index_type(i);
+	}
 	virtual node_index_type get_nr_nodes() const = 0;
-	virtual node_handle create_root_node_handle() const = 0;
-	virtual node_handle copy_node_handle(node_handle nh) const = 0;
-	virtual void release_node_handle(node_handle nh) const = 0;
-	virtual bool node_is_leaf(node_handle nh) const = 0;
-	virtual bool node_decent(node_handle nh, unsigned ci) const = 0;
-	virtual point_index_type node_nr_points(node_handle nh) const = 0;
-	virtual node_index_type node_index(node_handle nh) const = 0;
-	virtual point_index_type node_first_point(node_handle nh) const = 0;
+	virtual bool is_leaf(node_index_type ni) const = 0;
+	/// return index of child ci of node ni or invalid_node_index if child does not exist
+	virtual node_index_type get_child(node_index_type ni, unsigned ci) const = 0;
+	virtual point_index_type get_first_point(node_index_type ni) const = 0;
+	virtual point_index_type get_nr_points(node_index_type ni) const = 0;
+	/// return size of one node in bytes
+	virtual size_t get_node_size() const = 0;
+	/// return number of bytes allocated by the octree
+	virtual size_t get_memory_usage() const { return point_indices.capacity() * sizeof(point_index_type); }
+
+	/// value type reference to a node that carries the node box, which is updated incrementally during traversal
+	struct node_ref
+	{
+		node_index_type node_index;
+		cgv::box3 box;
+		unsigned level;
+	};
+	node_ref get_root_ref() const { return { root_node_index, domain, 0 }; }
+	/// set child to child ci of given node and return whether child exists
+	bool get_child_ref(const node_ref& nr, unsigned ci, node_ref& child) const {
+		node_index_type child_index = get_child(nr.node_index, ci);
+		if (child_index == invalid_node_index)
+			return false;
+		child = { child_index, child_box(nr.box, ci), nr.level + 1 };
+		return true;
+	}
+	/// iterator over the existing children of a node
+	struct child_iterator
+	{
+		const octree_base* octree_ptr;
+		node_ref parent;
+		unsigned child_index;
+		node_ref child;
+		child_iterator(const octree_base* _octree_ptr, const node_ref& _parent, unsigned _child_index)
+			: octree_ptr(_octree_ptr), parent(_parent), child_index(_child_index) {
+			skip_empty_children();
+		}
+		void skip_empty_children() {
+			while (child_index < 8 && !octree_ptr->get_child_ref(parent, child_index, child))
+				++child_index;
+		}
+		const node_ref& operator *() const { return child; }
+		const node_ref* operator ->() const { return &child; }
+		child_iterator& operator ++() { ++child_index; skip_empty_children(); return *this; }
+		bool operator == (const child_iterator& ci) const { return child_index == ci.child_index; }
+		bool operator != (const child_iterator& ci) const { return child_index != ci.child_index; }
+	};
+	struct child_range
+	{
+		const octree_base* octree_ptr;
+		node_ref parent;
+		child_iterator begin() const { return child_iterator(octree_ptr, parent, 0); }
+		child_iterator end() const { return child_iterator(octree_ptr, parent, 8); }
+	};
+	/// range over existing children for use in range based for loops; leaves yield an empty range
+	child_range children(const node_ref& nr) const { return { this, nr }; }
+	/// depth first iterator in pre-order that keeps pending nodes on a fixed size stack and never allocates
+	struct depth_first_iterator
+	{
+		const octree_base* octree_ptr;
+		node_ref stack[8 * max_depth + 1];
+		unsigned stack_size;
+		depth_first_iterator(const octree_base* _octree_ptr) : octree_ptr(_octree_ptr), stack_size(0) {
+			if (octree_ptr->get_nr_nodes() > 0)
+				stack[stack_size++] = octree_ptr->get_root_ref();
+		}
+		bool valid() const { return stack_size > 0; }
+		const node_ref& operator *() const { return stack[stack_size - 1]; }
+		const node_ref* operator ->() const { return &stack[stack_size - 1]; }
+		/// advance to next node, where descend = false skips the subtree of the current node
+		void next(bool descend = true) {
+			node_ref nr = stack[--stack_size];
+			if (!descend || nr.level >= max_depth)
+				return;
+			for (unsigned ci = 8; ci > 0; --ci)
+				if (octree_ptr->get_child_ref(nr, ci - 1, stack[stack_size]))
+					++stack_size;
+		}
+		depth_first_iterator& operator ++() { next(); return *this; }
+	};
+	depth_first_iterator depth_first() const { return depth_first_iterator(this); }
+	/// call visitor(const node_ref&) on all nodes in depth first pre-order; the subtree of a node is skipped if the visitor returns false
+	template <typename visitor_type>
+	void visit_depth_first(visitor_type visitor) const {
+		for (depth_first_iterator iter(this); iter.valid(); )
+			iter.next(visitor(*iter));
+	}
+	/// call visitor(const node_ref&) on all nodes level by level, where the nodes of the current and the next level are kept in two queues that are swapped per level
+	template <typename visitor_type>
+	void visit_breadth_first(visitor_type visitor) const {
+		if (get_nr_nodes() == 0)
+			return;
+		std::vector<node_ref> level_nodes(1, get_root_ref()), next_level_nodes;
+		while (!level_nodes.empty()) {
+			for (const node_ref& nr : level_nodes) {
+				visitor(nr);
+				if (nr.level >= max_depth)
+					continue;
+				node_ref child;
+				for (unsigned ci = 0; ci < 8; ++ci)
+					if (get_child_ref(nr, ci, child))
+						next_level_nodes.push_back(child);
+			}
+			level_nodes.swap(next_level_nodes);
+			next_level_nodes.clear();
+		}
+	}
+
+	/// margin by which node boxes are enlarged in spatial queries, as morton code based octrees assign points close to node boundaries by their quantized positions
+	static float get_query_margin(const cgv::box3& domain) { return domain.get_extent()[domain.get_max_extent_coord_index()] / float(1u << (max_depth - 2)); }
+	float get_query_margin() const { return get_query_margin(domain); }
+	/// return squared distance of p to box B enlarged by margin
+	static float sqr_distance_to_box(const cgv::vec3& p, const cgv::box3& B, float margin) {
+		float sqr_dist = 0;
+		for (unsigned c = 0; c < 3; ++c) {
+			float d = std::max(std::max(B.get_min_pnt()[c] - margin - p[c], p[c] - B.get_max_pnt()[c] - margin), 0.0f);
+			sqr_dist += d * d;
+		}
+		return sqr_dist;
+	}
+	typedef std::pair<float, point_index_type> distance_index_pair;
+	/// find the k points closest to p and store them as pairs of squared distance and point index in order of increasing distance in knn, which can be reused over queries to avoid allocations; excluded_point allows to skip the query point itself
+	void find_k_nearest(const cgv::vec3& p, unsigned k, std::vector<distance_index_pair>& knn, point_index_type excluded_point = point_index_type(-1)) const
+	{
+		knn.clear();
+		if (k == 0 || get_nr_nodes() == 0)
+			return;
+		float margin = get_query_margin();
+		// depth first search on a fixed size stack, where children are pushed from far to near such that nearer children are descended first, and nodes are pruned against the current k-th distance when popped
+		struct stack_entry { node_ref nr; float sqr_dist; };
+		stack_entry stack[8 * max_depth + 1];
+		unsigned stack_size = 0;
+		stack[stack_size++] = { get_root_ref(), 0.0f };
+		while (stack_size > 0) {
+			stack_entry e = stack[--stack_size];
+			if (knn.size() == k && e.sqr_dist >= knn.front().first)
+				continue;
+			if (is_leaf(e.nr.node_index)) {
+				point_index_type first_point = get_first_point(e.nr.node_index);
+				point_index_type end_point = first_point + get_nr_points(e.nr.node_index);
+				for (point_index_type pi = first_point; pi < end_point; ++pi) {
+					point_index_type i = point_indices[pi];
+					if (i == excluded_point)
+						continue;
+					float sqr_dist = (points_ptr[i] - p).sqr_length();
+					if (knn.size() < k) {
+						knn.push_back({ sqr_dist, i });
+						std::push_heap(knn.begin(), knn.end());
+					}
+					else if (sqr_dist < knn.front().first) {
+						std::pop_heap(knn.begin(), knn.end());
+						knn.back() = { sqr_dist, i };
+						std::push_heap(knn.begin(), knn.end());
+					}
+				}
+				continue;
+			}
+			stack_entry children[8];
+			unsigned nr_children = 0;
+			for (unsigned ci = 0; ci < 8; ++ci)
+				if (get_child_ref(e.nr, ci, children[nr_children].nr)) {
+					children[nr_children].sqr_dist = sqr_distance_to_box(p, children[nr_children].nr.box, margin);
+					++nr_children;
+				}
+			std::sort(children, children + nr_children, [](const stack_entry& a, const stack_entry& b) { return a.sqr_dist > b.sqr_dist; });
+			for (unsigned i = 0; i < nr_children; ++i)
+				stack[stack_size++] = children[i];
+		}
+		std::sort_heap(knn.begin(), knn.end());
+	}
+	/// return index of point closest to p or point_index_type(-1) for an empty octree
+	point_index_type find_closest(const cgv::vec3& p) const
+	{
+		std::vector<distance_index_pair> knn;
+		knn.reserve(1);
+		find_k_nearest(p, 1, knn);
+		return knn.empty() ? point_index_type(-1) : knn.front().second;
+	}
+	/// return index of the point with the smallest positive ray parameter t among the points within the cone around the ray origin + t * dir with normalized dir, whose radius is radius + slope * t,
+	/// or point_index_type(-1) if the cone contains no point; nodes are visited front to back and pruned by their bounding spheres against the cone and the ray parameter of the best point found so far
+	point_index_type find_first_in_cone(const cgv::vec3& origin, const cgv::vec3& dir, float radius, float slope) const
+	{
+		point_index_type best_index = point_index_type(-1);
+		if (get_nr_nodes() == 0)
+			return best_index;
+		float best_t = std::numeric_limits<float>::max();
+		float margin = get_query_margin();
+		// lower bound of the ray parameter of points inside of node box within the cone, or false if the bounding sphere misses the cone
+		auto bound = [&](const cgv::box3& box, float& min_t) {
+			cgv::vec3 c = box.get_center() - origin;
+			float R = 0.5f * box.get_extent().length() + 1.7320508f * margin;
+			float t = dot(c, dir);
+			float perp = std::sqrt(std::max(c.sqr_length() - t * t, 0.0f));
+			if (t + R <= 0 || perp - R > radius + slope * (t + R))
+				return false;
+			min_t = t - R;
+			return true;
+		};
+		struct stack_entry { node_ref nr; float min_t; };
+		stack_entry stack[8 * max_depth + 1];
+		unsigned stack_size = 0;
+		stack_entry root = { get_root_ref(), 0.0f };
+		if (!bound(root.nr.box, root.min_t))
+			return best_index;
+		stack[stack_size++] = root;
+		while (stack_size > 0) {
+			stack_entry e = stack[--stack_size];
+			if (e.min_t >= best_t)
+				continue;
+			if (is_leaf(e.nr.node_index)) {
+				point_index_type first_point = get_first_point(e.nr.node_index);
+				point_index_type end_point = first_point + get_nr_points(e.nr.node_index);
+				for (point_index_type pi = first_point; pi < end_point; ++pi) {
+					point_index_type i = point_indices[pi];
+					cgv::vec3 v = points_ptr[i] - origin;
+					float t = dot(v, dir);
+					if (t <= 0 || t >= best_t)
+						continue;
+					float r = radius + slope * t;
+					if (v.sqr_length() - t * t <= r * r) {
+						best_t = t;
+						best_index = i;
+					}
+				}
+				continue;
+			}
+			// children are pushed from back to front such that the front most child is popped first
+			stack_entry children[8];
+			unsigned nr_children = 0;
+			for (unsigned ci = 0; ci < 8; ++ci)
+				if (get_child_ref(e.nr, ci, children[nr_children].nr) && bound(children[nr_children].nr.box, children[nr_children].min_t))
+					++nr_children;
+			std::sort(children, children + nr_children, [](const stack_entry& a, const stack_entry& b) { return a.min_t > b.min_t; });
+			for (unsigned i = 0; i < nr_children; ++i)
+				stack[stack_size++] = children[i];
+		}
+		return best_index;
+	}
+	/// append indices of all points within given radius around p to result and, if given, their squared distances to sqr_dists
+	void find_in_radius(const cgv::vec3& p, float radius, std::vector<point_index_type>& result, std::vector<float>* sqr_dists = 0) const
+	{
+		float margin = get_query_margin(), sqr_radius = radius * radius;
+		visit_depth_first([&](const node_ref& nr) {
+			if (sqr_distance_to_box(p, nr.box, margin) > sqr_radius)
+				return false;
+			if (!is_leaf(nr.node_index))
+				return true;
+			point_index_type first_point = get_first_point(nr.node_index);
+			point_index_type end_point = first_point + get_nr_points(nr.node_index);
+			for (point_index_type pi = first_point; pi < end_point; ++pi) {
+				point_index_type i = point_indices[pi];
+				float sqr_dist = (points_ptr[i] - p).sqr_length();
+				if (sqr_dist <= sqr_radius) {
+					result.push_back(i);
+					if (sqr_dists)
+						sqr_dists->push_back(sqr_dist);
+				}
+			}
+			return false;
+		});
+	}
+	/// classify box of node enlarged by margin as disjoint from or contained in query box, where contained nodes only hold points inside of the query box
+	static void classify_node_box(const cgv::box3& node_box, float margin, const cgv::box3& box, bool& disjoint, bool& contained)
+	{
+		disjoint = false;
+		contained = true;
+		for (unsigned c = 0; c < 3; ++c) {
+			float lo = node_box.get_min_pnt()[c] - margin, hi = node_box.get_max_pnt()[c] + margin;
+			if (hi < box.get_min_pnt()[c] || lo > box.get_max_pnt()[c])
+				disjoint = true;
+			if (lo <= box.get_min_pnt()[c] || hi >= box.get_max_pnt()[c])
+				contained = false;
+		}
+	}
+	/// append indices of all points inside of box to result, where nodes that are contained in the box are reported without testing their points
+	void find_in_box(const cgv::box3& box, std::vector<point_index_type>& result) const
+	{
+		float margin = get_query_margin();
+		visit_depth_first([&](const node_ref& nr) {
+			bool disjoint, contained;
+			classify_node_box(nr.box, margin, box, disjoint, contained);
+			if (disjoint)
+				return false;
+			if (!contained && !is_leaf(nr.node_index))
+				return true;
+			point_index_type first_point = get_first_point(nr.node_index);
+			point_index_type end_point = first_point + get_nr_points(nr.node_index);
+			for (point_index_type pi = first_point; pi < end_point; ++pi)
+				if (contained || box.inside(points_ptr[point_indices[pi]]))
+					result.push_back(point_indices[pi]);
+			return false;
+		});
+	}
+	/// append indices of all points inside of box but not inside of excluded_box to result, such that only nodes overlapping the difference of both boxes are visited
+	void find_in_box_difference(const cgv::box3& box, const cgv::box3& excluded_box, std::vector<point_index_type>& result) const
+	{
+		float margin = get_query_margin();
+		visit_depth_first([&](const node_ref& nr) {
+			bool disjoint, contained, excluded_disjoint, excluded_contained;
+			classify_node_box(nr.box, margin, box, disjoint, contained);
+			if (disjoint)
+				return false;
+			classify_node_box(nr.box, margin, excluded_box, excluded_disjoint, excluded_contained);
+			if (excluded_contained)
+				return false;
+			bool all_inside = contained && excluded_disjoint;
+			if (!all_inside && !is_leaf(nr.node_index))
+				return true;
+			point_index_type first_point = get_first_point(nr.node_index);
+			point_index_type end_point = first_point + get_nr_points(nr.node_index);
+			for (point_index_type pi = first_point; pi < end_point; ++pi) {
+				const cgv::vec3& p = points_ptr[point_indices[pi]];
+				if (all_inside || (box.inside(p) && !excluded_box.inside(p)))
+					result.push_back(point_indices[pi]);
+			}
+			return false;
+		});
+	}
+
+	// thin compatibility layer of heap allocated node handles over node_ref
+	node_handle create_root_node_handle() const { return new node_ref(get_root_ref()); }
+	node_handle copy_node_handle(node_handle nh) const { return new node_ref(*reinterpret_cast<node_ref*>(nh)); }
+	void release_node_handle(node_handle nh) const { delete reinterpret_cast<node_ref*>(nh); }
+	bool node_is_leaf(node_handle nh) const { return is_leaf(reinterpret_cast<node_ref*>(nh)->node_index); }
+	bool node_decent(node_handle nh, unsigned ci) const {
+		node_ref& nr = *reinterpret_cast<node_ref*>(nh);
+		node_ref child;
+		if (!get_child_ref(nr, ci, child))
+			return false;
+		nr = child;
+		return true;
+	}
+	point_index_type node_nr_points(node_handle nh) const { return get_nr_points(reinterpret_cast<node_ref*>(nh)->node_index); }
+	node_index_type node_index(node_handle nh) const { return reinterpret_cast<node_ref*>(nh)->node_index; }
+	point_index_type node_first_point(node_handle nh) const { return get_first_point(reinterpret_cast<node_ref*>(nh)->node_index); }
 };
 
-struct simple_point_octree : public octree_base
+/// octree whose nodes store an 8 bit child mask and the index of their first child, where all children of a node are stored consecutively as one sibling block
+struct sibling_block_octree : public octree_base
 {
 	struct node
 	{
-		bool is_leaf;
+		/// bit ci is set if child ci exists
+		uint8_t child_mask;
+		uint8_t level;
+		/// index of first child, all children of a node are stored consecutively in order of increasing child index
+		node_index_type first_child;
 		point_index_type first_point;
 		point_index_type nr_points;
-		node_index_type children[8];
+		node(uint8_t _level = 0, point_index_type _first_point = 0, point_index_type _nr_points = 0) :
+			child_mask(0), level(_level), first_child(invalid_node_index), first_point(_first_point), nr_points(_nr_points) {}
+		bool is_leaf() const { return child_mask == 0; }
+		uint32_t get_nr_children() const { return child_mask_to_nr_children[child_mask & 15] + child_mask_to_nr_children[child_mask >> 4]; }
+		/// return index of child ci or invalid_node_index if child does not exist
+		node_index_type get_child(unsigned ci) const {
+			if ((child_mask & (1 << ci)) == 0)
+				return invalid_node_index;
+			uint8_t lower_mask = child_mask & ((1 << ci) - 1);
+			return first_child + child_mask_to_nr_children[lower_mask & 15] + child_mask_to_nr_children[lower_mask >> 4];
+		}
 	};
-	struct node_iterator
+	std::vector<node> nodes;
+	/// copy skeleton node si to node ni and splice in the nodes of subtree tasks, which reproduces the node order of sequential construction
+	template <typename subtree_task>
+	void stitch_node(const std::vector<node>& skeleton, node_index_type si, node_index_type ni, const std::vector<subtree_task>& tasks, const std::vector<size_t>& node_tasks)
+	{
+		if (node_tasks[si] != size_t(-1)) {
+			// descendants of task root are stored consecutively behind current nodes
+			const auto& task_nodes = tasks[node_tasks[si]].nodes;
+			node_index_type offset = node_index_type(nodes.size() - 1);
+			for (size_t j = 0; j < task_nodes.size(); ++j) {
+				node N = task_nodes[j];
+				if (!N.is_leaf())
+					N.first_child += offset;
+				if (j == 0)
+					nodes[ni] = N;
+				else
+					nodes.push_back(N);
+			}
+			return;
+		}
+		nodes[ni] = skeleton[si];
+		if (skeleton[si].is_leaf())
+			return;
+		node_index_type first_child = node_index_type(nodes.size());
+		node_index_type nr_children = skeleton[si].get_nr_children();
+		for (node_index_type k = 0; k < nr_children; ++k)
+			nodes.push_back(skeleton[skeleton[si].first_child + k]);
+		nodes[ni].first_child = first_child;
+		for (node_index_type k = 0; k < nr_children; ++k)
+			stitch_node(skeleton, skeleton[si].first_child + k, first_child + k, tasks, node_tasks);
+	}
+	/// add empty leaf as child ci of node ni by moving its sibling block to the end of the node array, which leaves the old block unreachable until compact_nodes is called
+	void add_child(node_index_type ni, unsigned ci)
+	{
+		node N = nodes[ni];
+		uint8_t child_mask = N.child_mask | uint8_t(1 << ci);
+		node_index_type first_child = node_index_type(nodes.size());
+		for (unsigned cj = 0; cj < 8; ++cj) {
+			if ((child_mask & (1 << cj)) == 0)
+				continue;
+			if (cj == ci)
+				nodes.push_back(node(N.level + 1));
+			else {
+				node child = nodes[N.get_child(cj)];
+				nodes.push_back(child);
+			}
+		}
+		nodes[ni].child_mask = child_mask;
+		nodes[ni].first_child = first_child;
+	}
+	/// copy node ci of compacted nodes and emit its reachable children in sibling block order of construction
+	void compact_node(std::vector<node>& compacted, node_index_type ci) const
+	{
+		node N = compacted[ci];
+		if (N.is_leaf())
+			return;
+		node_index_type first_child = node_index_type(compacted.size());
+		node_index_type nr_children = N.get_nr_children();
+		for (node_index_type k = 0; k < nr_children; ++k)
+			compacted.push_back(nodes[N.first_child + k]);
+		compacted[ci].first_child = first_child;
+		for (node_index_type k = 0; k < nr_children; ++k)
+			compact_node(compacted, first_child + k);
+	}
+	void compact_nodes()
+	{
+		std::vector<node> compacted(1, nodes[root_node_index]);
+		compacted.reserve(nodes.size());
+		compact_node(compacted, 0);
+		nodes.swap(compacted);
+		root_node_index = 0;
+	}
+	node_index_type get_nr_nodes() const { return node_index_type(nodes.size()); }
+	bool is_leaf(node_index_type ni) const { return nodes[ni].is_leaf(); }
+	node_index_type get_child(node_index_type ni, unsigned ci) const { return nodes[ni].get_child(ci); }
+	point_index_type get_first_point(node_index_type ni) const { return nodes[ni].first_point; }
+	point_index_type get_nr_points(node_index_type ni) const { return nodes[ni].nr_points; }
+	size_t get_node_size() const { return sizeof(node); }
+	size_t get_memory_usage() const { return octree_base::get_memory_usage() + nodes.capacity() * sizeof(node); }
+};
+
+/// octree constructed by recursive distribution of point indices on the children of each node
+struct simple_point_octree : public sibling_block_octree
+{
+	/// subtree whose construction is deferred to a parallel task
+	struct subtree_task
 	{
-		const simple_point_octree* octree_ptr;
 		node_index_type node_index;
 		cgv::box3 B;
-		const node& get_node() const { return octree_ptr->nodes[node_index]; }
-		bool is_leaf() const { return get_node().is_leaf; }
-		bool decent(unsigned ci) {
-			node_index_type child_index = get_node().children[ci];
-			if (child_index == invalid_node_index)
-				return false;
-			node_index = child_index;
-			B = octree_ptr->child_box(B, ci);
-			return true;
-		}
+		std::vector<uint32_t>::iterator begin, end;
+		unsigned level;
+		std::vector<node> nodes;
 	};
-	std::vector<node> nodes;
-	void construct_node(node_index_type ni, uint32_t max_nr_points_per_leaf, const cgv::box3& B, std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end, const cgv::vec3* points_ptr)
+	/// construct node ni of the given node vector by emitting its children into one sibling block and recursing; if tasks are given, subtrees below task_level are not constructed but collected as tasks
+	void construct_node(std::vector<node>& nodes, node_index_type ni, uint32_t max_nr_points_per_leaf, const cgv::box3& B, std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end, const cgv::vec3* points_ptr, unsigned level = 0, unsigned task_level = 0, std::vector<subtree_task>* tasks = 0)
 	{
 		point_index_type nr_points = point_index_type(end - begin);
-		auto& N = nodes[ni];
-		N.first_point = point_index_type(begin - point_indices.begin());
-		N.nr_points = nr_points;
-		// check for leaf node construction
-		if (N.is_leaf = (nr_points <= max_nr_points_per_leaf))
+		nodes[ni] = node(uint8_t(level), point_index_type(begin - point_indices.begin()), nr_points);
+		// check for leaf node construction, stop at maximum depth to not recurse infinitely on duplicate points
+		if (nr_points <= max_nr_points_per_leaf || level == max_depth)
 			return;
 
-		std::vector<uint32_t> child_point_indices[8];
-		distribute_points_on_children(child_point_indices, B, begin, end, points_ptr);
 		std::vector<uint32_t>::iterator child_begin[9];
-		reorder_indices_to_children(child_begin, child_point_indices, begin, end);
+		if (tasks) {
+			if (level == task_level) {
+				tasks->push_back({ ni, B, begin, end, level });
+				return;
+			}
+			parallel_distribute_points_on_children(child_begin, B, begin, end, points_ptr);
+		}
+		else {
+			std::vector<uint32_t> child_point_indices[8];
+			distribute_points_on_children(child_point_indices, B, begin, end, points_ptr);
+			reorder_indices_to_children(child_begin, child_point_indices, begin, end);
+		}
+		node_index_type first_child = node_index_type(nodes.size());
+		uint8_t child_mask = 0;
 		for (unsigned ci = 0; ci < 8; ++ci) {
-			if (child_begin[ci] == child_begin[ci+1])
-				nodes[ni].children[ci] = invalid_node_index;
-			else {
-				nodes[ni].children[ci] = node_index_type(nodes.size());
+			if (child_begin[ci] != child_begin[ci + 1]) {
+				child_mask |= 1 << ci;
 				nodes.emplace_back(node());
-				construct_node(nodes[ni].children[ci], max_nr_points_per_leaf, child_box(B, ci), child_begin[ci], child_begin[ci + 1], points_ptr);
 			}
 		}
+		nodes[ni].child_mask = child_mask;
+		nodes[ni].first_child = first_child;
+		node_index_type child_index = first_child;
+		for (unsigned ci = 0; ci < 8; ++ci)
+			if (child_begin[ci] != child_begin[ci + 1])
+				construct_node(nodes, child_index++, max_nr_points_per_leaf, child_box(B, ci), child_begin[ci], child_begin[ci + 1], points_ptr, level + 1, task_level, tasks);
 	}
-	void construct(const cgv::vec3* points_ptr, point_index_type nr_points, uint32_t max_nr_points_per_leaf, bool ensure_isotropic)
+	void construct_in_domain(const cgv::vec3* points_ptr, point_index_type nr_points, uint32_t max_nr_points_per_leaf)
 	{
+		this->points_ptr = points_ptr;
+		this->max_nr_points_per_leaf = max_nr_points_per_leaf;
 		point_indices.resize(nr_points);
 		std::iota(point_indices.begin(), point_indices.end(), 0);
 		nodes.clear();
 		nodes.push_back(node());
 		root_node_index = 0;
-		compute_domain(points_ptr, nr_points, ensure_isotropic);
-		construct_node(root_node_index, max_nr_points_per_leaf, domain, point_indices.begin(), point_indices.end(), points_ptr);
+		if (get_nr_threads(nr_threads) == 1) {
+			construct_node(nodes, root_node_index, max_nr_points_per_leaf, domain, point_indices.begin(), point_indices.end(), points_ptr);
+			return;
+		}
+		// construct top levels as skeleton and collect subtree tasks
+		std::vector<subtree_task> tasks;
+		std::vector<node> skeleton(1, node());
+		construct_node(skeleton, 0, max_nr_points_per_leaf, domain, point_indices.begin(), point_indices.end(), points_ptr, 0, get_task_level(), &tasks);
+		// build subtrees in parallel starting with the largest ones
+		std::vector<size_t> task_order(tasks.size());
+		std::iota(task_order.begin(), task_order.end(), 0);
+		std::sort(task_order.begin(), task_order.end(), [&](size_t i, size_t j) { return tasks[i].end - tasks[i].begin > tasks[j].end - tasks[j].begin; });
+		parallel_tasks(tasks.size(), [&](size_t i) {
+			subtree_task& t = tasks[task_order[i]];
+			t.nodes.push_back(node());
+			construct_node(t.nodes, 0, max_nr_points_per_leaf, t.B, t.begin, t.end, points_ptr, t.level);
+		}, nr_threads);
+		// stitch node arrays together
+		std::vector<size_t> node_tasks(skeleton.size(), size_t(-1));
+		size_t nr_nodes = skeleton.size();
+		for (size_t ti = 0; ti < tasks.size(); ++ti) {
+			node_tasks[tasks[ti].node_index] = ti;
+			nr_nodes += tasks[ti].nodes.size() - 1;
+		}
+		nodes.reserve(nr_nodes);
+		stitch_node(skeleton, 0, root_node_index, tasks, node_tasks);
+	}
+	/// leaf that overflowed during insertion and is subdivided afterwards
+	struct overflow_leaf
+	{
+		node_index_type node_index;
+		cgv::box3 B;
+		unsigned level;
+	};
+	/// rewrite the point range of node ni starting at cursor in depth first order, where leaves keep their old points followed by their new points
+	void relayout_node(node_index_type ni, const cgv::box3& B, const std::vector<point_index_type>& old_point_indices,
+		const std::vector<point_index_type>& leaf_offsets, const std::vector<point_index_type>& new_points, point_index_type& cursor, std::vector<overflow_leaf>& overflow_leaves)
+	{
+		node& N = nodes[ni];
+		point_index_type first_point = cursor;
+		if (N.is_leaf()) {
+			cursor = point_index_type(std::copy(old_point_indices.begin() + N.first_point, old_point_indices.begin() + N.first_point + N.nr_points, point_indices.begin() + cursor) - point_indices.begin());
+			cursor = point_index_type(std::copy(new_points.begin() + leaf_offsets[ni], new_points.begin() + leaf_offsets[ni + 1], point_indices.begin() + cursor) - point_indices.begin());
+			if (cursor - first_point > max_nr_points_per_leaf && N.level < max_depth)
+				overflow_leaves.push_back({ ni, B, N.level });
+		}
+		else {
+			for (unsigned ci = 0; ci < 8; ++ci)
+				if (N.get_child(ci) != invalid_node_index)
+					relayout_node(N.get_child(ci), child_box(B, ci), old_point_indices, leaf_offsets, new_points, cursor, overflow_leaves);
+		}
+		N.first_point = first_point;
+		N.nr_points = cursor - first_point;
+	}
+	void insert_points_in_domain(point_index_type begin, point_index_type end)
+	{
+		// create missing children first, as moving sibling blocks would invalidate leaf indices found before
+		for (point_index_type pi = begin; pi < end; ++pi) {
+			node_index_type ni = root_node_index;
+			cgv::box3 B = domain;
+			while (!nodes[ni].is_leaf()) {
+				unsigned ci = get_child_index(points_ptr[pi], B.get_center());
+				if (nodes[ni].get_child(ci) == invalid_node_index)
+					add_child(ni, ci);
+				ni = nodes[ni].get_child(ci);
+				B = child_box(B, ci);
+			}
+		}
+		std::vector<node_index_type> point_leaves(end - begin);
+		parallel_for(begin, end, [&](size_t b, size_t e) {
+			for (size_t pi = b; pi < e; ++pi) {
+				node_index_type ni = root_node_index;
+				cgv::box3 B = domain;
+				while (!nodes[ni].is_leaf()) {
+					unsigned ci = get_child_index(points_ptr[pi], B.get_center());
+					ni = nodes[ni].get_child(ci);
+					B = child_box(B, ci);
+				}
+				point_leaves[pi - begin] = ni;
+			}
+		}, nr_threads);
+		std::vector<point_index_type> leaf_offsets, new_points;
+		bucket_points_by_leaf(point_leaves, begin, get_nr_nodes(), leaf_offsets, new_points);
+		// rewrite point ranges, subdivide overflowing leaves and restore the node order of construction
+		std::vector<point_index_type> old_point_indices(end);
+		point_indices.swap(old_point_indices);
+		point_index_type cursor = 0;
+		std::vector<overflow_leaf> overflow_leaves;
+		relayout_node(root_node_index, domain, old_point_indices, leaf_offsets, new_points, cursor, overflow_leaves);
+		for (const auto& L : overflow_leaves) {
+			auto leaf_begin = point_indices.begin() + nodes[L.node_index].first_point;
+			construct_node(nodes, L.node_index, max_nr_points_per_leaf, L.B, leaf_begin, leaf_begin + nodes[L.node_index].nr_points, points_ptr, L.level);
+		}
+		compact_nodes();
 	}
-	node_iterator get_root() const { return { this, root_node_index, domain }; }
-	node_index_type get_nr_nodes() const { return node_index_type(nodes.size()); }
-	node_handle create_root_node_handle() const { return new node_iterator(get_root()); }
-	void release_node_handle(node_handle nh) const { delete reinterpret_cast<node_iterator*>(nh); }
-	node_handle copy_node_handle(node_handle nh) const { return new node_iterator(*reinterpret_cast<node_iterator*>(nh)); }
-	bool node_is_leaf(node_handle nh) const { return reinterpret_cast<node_iterator*>(nh)->is_leaf(); }
-	bool node_decent(node_handle nh, unsigned ci) const { return reinterpret_cast<node_iterator*>(nh)->decent(ci); }
-	node_index_type node_index(node_handle nh) const { return reinterpret_cast<node_iterator*>(nh)->node_index; }
-	point_index_type node_nr_points(node_handle nh) const { return reinterpret_cast<node_iterator*>(nh)->get_node().nr_points; }
-	point_index_type node_first_point(node_handle nh) const { return reinterpret_cast<node_iterator*>(nh)->get_node().first_point; }
 };
-/*
-struct point_octree
+
+/// linear octree constructed from radix sorted morton codes of the quantized point positions
+struct point_octree : public sibling_block_octree
 {
-	struct node {
-		struct bitfield_type {
-			uint8_t  child_mask : 8;
-			uint8_t  lod : 6;
-		} bitfield;
-		struct child_iterator {
-			uint8_t child_mask;
-			uint8_t child_index;
-			uint32_t node_index;
-			child_iterator(uint8_t _child_mask, uint8_t _child_index, uint32_t _node_index)
-				: child_mask(_child_mask), child_index(_child_index), node_index(_node_index)
-			{
-				skip_empty_children();
+	/// morton codes of points sorted in increasing order and thus ordered consistently with point_indices
+	std::vector<uint_fast64_t> morton_indices;
+	/// quantize n points to a grid of 2^max_depth cells per dimension over the domain and store their morton codes in m
+	static void compute_morton_codes(const cgv::box3& domain, const cgv::vec3* points_ptr, size_t n, uint64_t* m, MortonBackend backend = MB_AUTO)
+	{
+		float nr_cells = float(1u << max_depth);
+		cgv::vec3 extent = domain.get_extent();
+		cgv::vec3 scale;
+		for (unsigned c = 0; c < 3; ++c)
+			scale[c] = extent[c] > 0 ? nr_cells / extent[c] : 0.0f;
+		uint32_t max_coord = (1u << max_depth) - 1;
+		if (backend == MB_AUTO)
+			backend = get_best_morton_backend();
+		// quantize chunks of points into a small buffer that is encoded with the batch kernel
+		static const size_t chunk_size = 1024;
+		uint32_t xyz[3 * chunk_size];
+		for (size_t chunk_begin = 0; chunk_begin < n; chunk_begin += chunk_size) {
+			size_t chunk_n = std::min(chunk_size, n - chunk_begin);
+			for (size_t i = 0; i < chunk_n; ++i) {
+				cgv::vec3 q = scale * (points_ptr[chunk_begin + i] - domain.get_min_pnt());
+				for (unsigned c = 0; c < 3; ++c)
+					xyz[3 * i + c] = std::min(uint32_t(std::max(q[c], 0.0f)), max_coord);
 			}
-			void skip_empty_children()
-			{
-				while (child_index < 8 && (child_mask & 1) == 0) {
-					child_mask >>= 1;
-					++child_index;
-					++node_index;
+			morton3D_64_encode_batch(xyz, m + chunk_begin, chunk_n, backend);
+		}
+	}
+	/// compute morton codes of all points in parallel
+	void extract_morton_indices(const cgv::vec3* points_ptr, point_index_type nr_points)
+	{
+		morton_indices.resize(nr_points);
+		MortonBackend backend = get_best_morton_backend();
+		parallel_for(0, nr_points, [&](size_t begin, size_t end) {
+			compute_morton_codes(domain, points_ptr + begin, end - begin, reinterpret_cast<uint64_t*>(morton_indices.data() + begin), backend);
+		}, nr_threads);
+	}
+	/// sort n morton codes together with point indices by a least significant digit radix sort over 11 bit digits, where each pass is split into blocks that are histogrammed and scattered in parallel
+	static void sort_morton_codes(uint_fast64_t* codes, point_index_type* indices, size_t n, unsigned nr_threads = 0)
+	{
+		static const unsigned digit_bits = 11, nr_digits = (3 * max_depth + digit_bits - 1) / digit_bits, radix = 1 << digit_bits;
+		size_t nr_blocks = get_nr_blocks(n, nr_threads, 65536);
+		std::vector<size_t> block_offsets(nr_blocks * radix);
+		std::vector<uint_fast64_t> tmp_codes(n);
+		std::vector<point_index_type> tmp_indices(n);
+		uint_fast64_t* src_codes = codes, *dst_codes = tmp_codes.data();
+		point_index_type* src_indices = indices, *dst_indices = tmp_indices.data();
+		for (unsigned d = 0; d < nr_digits; ++d) {
+			unsigned shift = d * digit_bits;
+			std::fill(block_offsets.begin(), block_offsets.end(), 0);
+			parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t begin, size_t end) {
+				size_t* histogram = &block_offsets[bi * radix];
+				for (size_t i = begin; i < end; ++i)
+					++histogram[(src_codes[i] >> shift) & (radix - 1)];
+			}, nr_threads);
+			// skip pass if all codes share the same digit
+			size_t offset = 0;
+			bool skip_pass = false;
+			for (unsigned r = 0; r < radix && !skip_pass; ++r) {
+				size_t count = 0;
+				for (size_t bi = 0; bi < nr_blocks; ++bi) {
+					size_t block_count = block_offsets[bi * radix + r];
+					block_offsets[bi * radix + r] = offset;
+					offset += block_count;
+					count += block_count;
 				}
+				skip_pass = count == n;
 			}
-			bool operator == (const child_iterator& ci) const { return child_index == ci.child_index; }
-			bool operator < (const child_iterator& ci) const { return child_index < ci.child_index; }
-			bool operator != (const child_iterator& ci) const { return child_index != ci.child_index; }
-			child_iterator& operator ++() {
-				while (child_index < 8) {
-					child_mask >>= 1;
-					++child_index;
-					++node_index;
-					if ((child_mask & 1) == 1)
-						break;
+			if (skip_pass)
+				continue;
+			parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t begin, size_t end) {
+				size_t* block_offset = &block_offsets[bi * radix];
+				for (size_t i = begin; i < end; ++i) {
+					size_t j = block_offset[(src_codes[i] >> shift) & (radix - 1)]++;
+					dst_codes[j] = src_codes[i];
+					dst_indices[j] = src_indices[i];
 				}
-				return *this;
-			}
-		};
-		uint32_t first_index;
-		uint32_t nr_points;
-		node(uint8_t lod, uint32_t _first_index, uint32_t _nr_points) : first_index(_first_index), nr_points(_nr_points) {
-			bitfield.child_mask = 0;
-			bitfield.lod = lod;
-		}
-		bool is_leaf() const { return bitfield.child_mask == 0; }
-		child_iterator begin() const { return child_iterator(bitfield.child_mask, 0, first_index); }
-		child_iterator end() const { return child_iterator(0, 8, first_index + 8); }
-		uint32_t get_nr_children() const { return child_mask_to_nr_children[bitfield.child_mask & 15] + child_mask_to_nr_children[bitfield.child_mask / 16]; }
-		uint32_t get_first_point_index() const { return first_index; }
-		uint32_t get_nr_points() const { return nr_points; }
-	};
-	std::vector<uint32_t> point_indices;
-	std::vector<uint_fast64_t> morton_indices;
-	std::vector<node> nodes;
-	void extract_morton_indices(const std::vector<cgv::vec3>& points, uint32_t max_depth = 12) {
-		assert(max_depth < 21);
-		uint32_t nr_cells = pow(2u, max_depth);
-		cgv::vec3 scale = cgv::vec3(float(nr_cells)) / domain.get_extent();
-		morton_indices.clear();
-		for (const auto& point : points) {
-			cgv::uvec3 xyz(scale * (point - domain.get_min_pnt()));
-			morton_indices.emplace_back(morton3D_64_encode(xyz[0], xyz[1], xyz[2]));
+			}, nr_threads);
+			std::swap(src_codes, dst_codes);
+			std::swap(src_indices, dst_indices);
+		}
+		// copy back if result ended up in temporary buffers
+		if (src_codes != codes) {
+			parallel_for(0, n, [&](size_t b, size_t e) {
+				std::copy(src_codes + b, src_codes + e, codes + b);
+				std::copy(src_indices + b, src_indices + e, indices + b);
+			}, nr_threads);
 		}
 	}
-
-	void construct_node(node& N, uint32_t max_nr_points_per_leaf, const cgv::box3& B, std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end, const std::vector<cgv::vec3>& points)
+	void sort_morton_indices()
+	{
+		sort_morton_codes(morton_indices.data(), point_indices.data(), morton_indices.size(), nr_threads);
+	}
+	/// return 3 bit child index of morton code on given level
+	static unsigned morton_child_index(uint_fast64_t m, unsigned level) { return unsigned(m >> (3 * (max_depth - level - 1))) & 7; }
+	/// subtree whose construction is deferred to a parallel task
+	struct subtree_task
+	{
+		node_index_type node_index;
+		std::vector<node> nodes;
+	};
+	/// emit children of node ni into one sibling block and recurse, child ranges are found by binary search in the sorted codes; if tasks are given, subtrees below task_level are collected as tasks
+	void construct_node(std::vector<node>& nodes, node_index_type ni, uint32_t max_nr_points_per_leaf, unsigned task_level = 0, std::vector<subtree_task>* tasks = 0)
 	{
-		// check for leaf node construction
-		if (N.get_nr_points() <= max_nr_points_per_leaf)
+		node N = nodes[ni];
+		if (N.nr_points <= max_nr_points_per_leaf || N.level == max_depth)
+			return;
+		if (tasks && N.level == task_level) {
+			tasks->push_back({ ni });
 			return;
-		// distribute points on children
-		cgv::vec3 center = B.get_center();
-		std::vector<uint32_t> child_point_indices[8];
-		for (auto iter = begin; iter != end; ++iter) {
-			const cgv::vec3& point = points[*iter];
-			uint8_t child_index =
-				(point[0] > center[0] ? 1 : 0) +
-				(point[1] > center[1] ? 2 : 0) +
-				(point[2] > center[2] ? 4 : 0);
-			child_point_indices[child_index].emplace_back(*iter);
-		}
-		// determine child mask, allocate nodes and rearrange point indices along child node order
-		uint8_t child_mask_bit = 1;
-		uint32_t first_point_index = N.get_first_point_index();
-		N.first_index = nodes.size();
-		auto iter = begin;
-		uint32_t ci;
-		for (ci = 0; ci < 8; ++ci) {
-			uint32_t nr_points = child_point_indices[ci].size();
-			if (nr_points > 0) {
-				N.bitfield.child_mask |= child_mask_bit;
-				nodes.emplace_back(node(N.bitfield.lod + 1, first_point_index, nr_points));
-				for (uint32_t i = 0; i < nr_points; ++i, ++iter)
-					*iter = child_point_indices[ci][i];
-				first_point_index += nr_points;
-			}
-			child_mask_bit <<= 1;
 		}
-		// construct child nodes recursively
-		uint32_t ni = N.first_index;
-		for (ci = 0; ci < 8; ++ci) {
-			construct_node(nodes[ni], max_nr_points_per_leaf, child_box[i], , , points);
+		auto begin = morton_indices.begin() + N.first_point;
+		auto end = begin + N.nr_points;
+		node_index_type first_child = node_index_type(nodes.size());
+		uint8_t child_mask = 0;
+		for (unsigned ci = 0; ci < 8 && begin != end; ++ci) {
+			auto child_end = std::upper_bound(begin, end, ci, [&](unsigned c, uint_fast64_t m) { return c < morton_child_index(m, N.level); });
+			if (child_end != begin) {
+				child_mask |= 1 << ci;
+				nodes.emplace_back(node(N.level + 1, point_index_type(begin - morton_indices.begin()), point_index_type(child_end - begin)));
+			}
+			begin = child_end;
 		}
+		nodes[ni].child_mask = child_mask;
+		nodes[ni].first_child = first_child;
+		node_index_type last_child = node_index_type(nodes.size());
+		for (node_index_type ci = first_child; ci < last_child; ++ci)
+			construct_node(nodes, ci, max_nr_points_per_leaf, task_level, tasks);
 	}
-	void construct(const std::vector<cgv::vec3>& points, uint32_t max_nr_points_per_leaf, bool ensure_isotropic)
+	void construct_in_domain(const cgv::vec3* points_ptr, point_index_type nr_points, uint32_t max_nr_points_per_leaf)
 	{
-		point_indices.resize(points.size());
+		this->points_ptr = points_ptr;
+		this->max_nr_points_per_leaf = max_nr_points_per_leaf;
+		point_indices.resize(nr_points);
 		std::iota(point_indices.begin(), point_indices.end(), 0);
+		extract_morton_indices(points_ptr, nr_points);
+		sort_morton_indices();
 		nodes.clear();
-		nodes.push_back(node(0, 0, point_indices.size()));
+		nodes.push_back(node(0, 0, nr_points));
 		root_node_index = 0;
-		construct_node(nodes.front(), max_nr_points_per_leaf, domain, point_indices.begin(), point_indices.end(), points);
+		if (get_nr_threads(nr_threads) == 1) {
+			construct_node(nodes, root_node_index, max_nr_points_per_leaf);
+			return;
+		}
+		// construct top levels as skeleton and collect subtree tasks
+		std::vector<subtree_task> tasks;
+		std::vector<node> skeleton = nodes;
+		construct_node(skeleton, 0, max_nr_points_per_leaf, get_task_level(), &tasks);
+		// build subtrees in parallel starting with the largest ones
+		std::vector<size_t> task_order(tasks.size());
+		std::iota(task_order.begin(), task_order.end(), 0);
+		std::sort(task_order.begin(), task_order.end(), [&](size_t i, size_t j) { return skeleton[tasks[i].node_index].nr_points > skeleton[tasks[j].node_index].nr_points; });
+		parallel_tasks(tasks.size(), [&](size_t i) {
+			subtree_task& t = tasks[task_order[i]];
+			t.nodes.push_back(skeleton[t.node_index]);
+			construct_node(t.nodes, 0, max_nr_points_per_leaf);
+		}, nr_threads);
+		// stitch node arrays together
+		std::vector<size_t> node_tasks(skeleton.size(), size_t(-1));
+		size_t nr_nodes = skeleton.size();
+		for (size_t ti = 0; ti < tasks.size(); ++ti) {
+			node_tasks[tasks[ti].node_index] = ti;
+			nr_nodes += tasks[ti].nodes.size() - 1;
+		}
+		nodes.reserve(nr_nodes);
+		stitch_node(skeleton, 0, root_node_index, tasks, node_tasks);
+	}
+	/// rewrite the point range of node ni starting at cursor in depth first order, where leaves merge their old points with their new points sorted by morton code
+	void relayout_node(node_index_type ni, const std::vector<point_index_type>& old_point_indices, const std::vector<uint_fast64_t>& old_morton_indices,
+		const std::vector<point_index_type>& leaf_offsets, const std::vector<point_index_type>& new_points, const std::vector<uint_fast64_t>& new_morton_indices,
+		point_index_type& cursor, std::vector<node_index_type>& overflow_leaves)
+	{
+		node& N = nodes[ni];
+		point_index_type first_point = cursor;
+		if (N.is_leaf()) {
+			// on equal codes old points come first, which keeps points with equal codes ordered by index as in construction
+			point_index_type i = N.first_point, i_end = N.first_point + N.nr_points, j = leaf_offsets[ni], j_end = leaf_offsets[ni + 1];
+			while (i < i_end || j < j_end) {
+				if (j == j_end || (i < i_end && old_morton_indices[i] <= new_morton_indices[j])) {
+					morton_indices[cursor] = old_morton_indices[i];
+					point_indices[cursor++] = old_point_indices[i++];
+				}
+				else {
+					morton_indices[cursor] = new_morton_indices[j];
+					point_indices[cursor++] = new_points[j++];
+				}
+			}
+			if (cursor - first_point > max_nr_points_per_leaf && N.level < max_depth)
+				overflow_leaves.push_back(ni);
+		}
+		else {
+			for (node_index_type k = 0; k < N.get_nr_children(); ++k)
+				relayout_node(N.first_child + k, old_point_indices, old_morton_indices, leaf_offsets, new_points, new_morton_indices, cursor, overflow_leaves);
+		}
+		N.first_point = first_point;
+		N.nr_points = cursor - first_point;
+	}
+	void insert_points_in_domain(point_index_type begin, point_index_type end)
+	{
+		point_index_type n = end - begin;
+		std::vector<uint_fast64_t> codes(n);
+		MortonBackend backend = get_best_morton_backend();
+		parallel_for(0, n, [&](size_t b, size_t e) {
+			compute_morton_codes(domain, points_ptr + begin + b, e - b, reinterpret_cast<uint64_t*>(codes.data() + b), backend);
+		}, nr_threads);
+		// create missing children first, as moving sibling blocks would invalidate leaf indices found before
+		for (point_index_type i = 0; i < n; ++i) {
+			node_index_type ni = root_node_index;
+			while (!nodes[ni].is_leaf()) {
+				unsigned ci = morton_child_index(codes[i], nodes[ni].level);
+				if (nodes[ni].get_child(ci) == invalid_node_index)
+					add_child(ni, ci);
+				ni = nodes[ni].get_child(ci);
+			}
+		}
+		std::vector<node_index_type> point_leaves(n);
+		parallel_for(0, n, [&](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				node_index_type ni = root_node_index;
+				while (!nodes[ni].is_leaf())
+					ni = nodes[ni].get_child(morton_child_index(codes[i], nodes[ni].level));
+				point_leaves[i] = ni;
+			}
+		}, nr_threads);
+		std::vector<point_index_type> leaf_offsets, new_points;
+		bucket_points_by_leaf(point_leaves, begin, get_nr_nodes(), leaf_offsets, new_points);
+		// sort new points of each leaf by morton code and point index
+		std::vector<uint_fast64_t> new_morton_indices(n);
+		parallel_for(0, get_nr_nodes(), [&](size_t b, size_t e) {
+			for (size_t ni = b; ni < e; ++ni) {
+				auto leaf_begin = new_points.begin() + leaf_offsets[ni], leaf_end = new_points.begin() + leaf_offsets[ni + 1];
+				std::sort(leaf_begin, leaf_end, [&](point_index_type pi, point_index_type pj) {
+					return codes[pi - begin] < codes[pj - begin] || (codes[pi - begin] == codes[pj - begin] && pi < pj);
+				});
+				for (auto iter = leaf_begin; iter != leaf_end; ++iter)
+					new_morton_indices[iter - new_points.begin()] = codes[*iter - begin];
+			}
+		}, nr_threads, 256);
+		// rewrite point ranges, subdivide overflowing leaves and restore the node order of construction
+		std::vector<point_index_type> old_point_indices(end);
+		std::vector<uint_fast64_t> old_morton_indices(end);
+		point_indices.swap(old_point_indices);
+		morton_indices.swap(old_morton_indices);
+		point_index_type cursor = 0;
+		std::vector<node_index_type> overflow_leaves;
+		relayout_node(root_node_index, old_point_indices, old_morton_indices, leaf_offsets, new_points, new_morton_indices, cursor, overflow_leaves);
+		for (node_index_type ni : overflow_leaves)
+			construct_node(nodes, ni, max_nr_points_per_leaf);
+		compact_nodes();
 	}
+	size_t get_memory_usage() const { return sibling_block_octree::get_memory_usage() + morton_indices.capacity() * sizeof(uint_fast64_t); }
 };
-*/
\ No newline at end of file
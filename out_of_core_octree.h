@@ -0,0 +1,531 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "octrees.h"
+#include "mapped_file.h"
+
+/// source of points that are streamed in chunks, which is restarted for each pass of the out-of-core octree construction
+struct point_chunk_source
+{
+	virtual ~point_chunk_source() {}
+	/// restart streaming at the first point and return whether this succeeded
+	virtual bool restart() = 0;
+	/// replace points by the next chunk of at most max_nr_points points and return false at the end of the stream
+	virtual bool read_chunk(std::vector<cgv::vec3>& points, size_t max_nr_points) = 0;
+};
+
+/// chunk source over points in memory
+struct memory_point_chunk_source : public point_chunk_source
+{
+	const cgv::vec3* points_ptr;
+	size_t nr_points, position;
+	memory_point_chunk_source(const cgv::vec3* _points_ptr, size_t _nr_points) : points_ptr(_points_ptr), nr_points(_nr_points), position(0) {}
+	bool restart() { position = 0; return true; }
+	bool read_chunk(std::vector<cgv::vec3>& points, size_t max_nr_points) {
+		size_t n = std::min(max_nr_points, nr_points - position);
+		points.assign(points_ptr + position, points_ptr + position + n);
+		position += n;
+		return n > 0;
+	}
+};
+
+/// chunk source over an ascii file with one point per line, where the first three numbers of a line are the coordinates and further columns are ignored
+struct xyz_file_point_chunk_source : public point_chunk_source
+{
+	std::string file_name;
+	std::ifstream is;
+	xyz_file_point_chunk_source(const std::string& _file_name) : file_name(_file_name) {}
+	bool restart() {
+		is.close();
+		is.clear();
+		is.open(file_name);
+		return is.is_open();
+	}
+	bool read_chunk(std::vector<cgv::vec3>& points, size_t max_nr_points) {
+		points.clear();
+		std::string line;
+		while (points.size() < max_nr_points && std::getline(is, line)) {
+			cgv::vec3 p;
+			if (sscanf(line.c_str(), "%f %f %f", &p[0], &p[1], &p[2]) == 3)
+				points.push_back(p);
+		}
+		return !points.empty();
+	}
+};
+
+/// header of an out-of-core octree file, which is followed by the point positions in morton order starting at points_offset and the point_octree nodes starting at nodes_offset
+struct out_of_core_octree_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t nr_points;
+	uint32_t nr_nodes;
+	uint32_t max_nr_points_per_leaf;
+	uint32_t nr_points_per_page;
+	float domain[6];
+	uint64_t points_offset;
+	uint64_t nodes_offset;
+};
+
+/// builds an out-of-core octree file from a point stream that need not fit into memory
+class out_of_core_octree_builder
+{
+public:
+	typedef point_octree::node node;
+	typedef octree_base::node_index_type node_index_type;
+	/// level of the morton cells over which points are histogrammed and partitioned into runs
+	static const unsigned histogram_level = 7;
+	static const uint32_t nr_cells = 1u << (3 * histogram_level);
+	static const uint32_t nr_points_per_page = 1u << 16;
+	/// offset of point data in the file, which is a multiple of the allocation granularity of all supported platforms
+	static const uint64_t points_offset = 1u << 16;
+	uint32_t max_nr_points_per_leaf = 4096;
+	/// approximate bound on the memory used during construction, which determines the number of points sorted in memory at once
+	size_t memory_budget = size_t(1) << 30;
+protected:
+	/// a point together with its morton code as stored in the temporary partition file
+	struct record
+	{
+		uint64_t code;
+		cgv::vec3 point;
+	};
+	cgv::box3 domain;
+	std::vector<uint32_t> cell_offsets;
+	std::vector<node> nodes;
+	/// pairs of node index and histogram cell of nodes whose subtrees are constructed from the sorted points of their run
+	std::vector<std::pair<node_index_type, uint32_t>> deferred_cells;
+	/// construct nodes above the histogram level from the cell counts in sibling block order
+	void construct_skeleton_node(node_index_type ni, uint32_t prefix)
+	{
+		node N = nodes[ni];
+		if (N.nr_points <= max_nr_points_per_leaf)
+			return;
+		if (N.level == histogram_level) {
+			deferred_cells.push_back({ ni, prefix });
+			return;
+		}
+		unsigned child_shift = 3 * (histogram_level - N.level - 1);
+		node_index_type first_child = node_index_type(nodes.size());
+		uint32_t child_prefixes[8];
+		uint8_t child_mask = 0;
+		for (unsigned ci = 0; ci < 8; ++ci) {
+			uint32_t child_prefix = 8 * prefix + ci;
+			uint32_t begin = cell_offsets[child_prefix << child_shift], end = cell_offsets[(child_prefix + 1) << child_shift];
+			if (end > begin) {
+				child_prefixes[nodes.size() - first_child] = child_prefix;
+				child_mask |= 1 << ci;
+				nodes.emplace_back(node(N.level + 1, begin, end - begin));
+			}
+		}
+		nodes[ni].child_mask = child_mask;
+		nodes[ni].first_child = first_child;
+		node_index_type last_child = node_index_type(nodes.size());
+		for (node_index_type ci = first_child; ci < last_child; ++ci)
+			construct_skeleton_node(ci, child_prefixes[ci - first_child]);
+	}
+public:
+	/// construct octree file in four passes over the source: domain computation, histogram over morton cells, partition of points into runs of cells that fit into the memory budget, and per run sorting and subtree construction
+	bool build(point_chunk_source& source, const std::string& file_name, std::ostream& log)
+	{
+		static const size_t chunk_size = 1 << 20;
+		const unsigned cell_shift = 3 * (octree_base::max_depth - histogram_level);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<cgv::vec3> chunk;
+		std::vector<uint64_t> codes;
+
+		// pass 1: domain and number of points
+		domain.invalidate();
+		uint64_t nr_points = 0;
+		if (!source.restart()) {
+			log << "could not open point source" << std::endl;
+			return false;
+		}
+		while (source.read_chunk(chunk, chunk_size)) {
+			for (const auto& p : chunk)
+				domain.add_point(p);
+			nr_points += chunk.size();
+		}
+		if (nr_points == 0 || nr_points >= uint64_t(uint32_t(-1))) {
+			log << "out-of-core octree supports between 1 and 2^32-2 points but source provided " << nr_points << std::endl;
+			return false;
+		}
+		unsigned i = domain.get_max_extent_coord_index(), j = (i + 1) % 3, k = (i + 2) % 3;
+		float a = domain.get_extent()[i];
+		domain.ref_max_pnt()[j] = domain.ref_min_pnt()[j] + a;
+		domain.ref_max_pnt()[k] = domain.ref_min_pnt()[k] + a;
+
+		// pass 2: histogram of points over morton cells of histogram level
+		cell_offsets.assign(nr_cells + 1, 0);
+		source.restart();
+		while (source.read_chunk(chunk, chunk_size)) {
+			codes.resize(chunk.size());
+			point_octree::compute_morton_codes(domain, chunk.data(), chunk.size(), codes.data());
+			for (uint64_t m : codes)
+				++cell_offsets[(m >> cell_shift) + 1];
+		}
+		for (uint32_t c = 0; c < nr_cells; ++c)
+			cell_offsets[c + 1] += cell_offsets[c];
+		if (cell_offsets[nr_cells] != nr_points) {
+			log << "point source changed between passes" << std::endl;
+			return false;
+		}
+
+		// group consecutive cells into runs that fit into the memory budget, where a cell exceeding the budget forms a run on its own
+		size_t run_capacity = std::max(memory_budget / 64, size_t(1));
+		std::vector<uint32_t> run_begin_cells(1, 0), cell_runs(nr_cells);
+		for (uint32_t c = 0; c < nr_cells; ++c) {
+			if (c > run_begin_cells.back() && cell_offsets[c + 1] - cell_offsets[run_begin_cells.back()] > run_capacity)
+				run_begin_cells.push_back(c);
+			cell_runs[c] = uint32_t(run_begin_cells.size() - 1);
+		}
+		run_begin_cells.push_back(uint32_t(nr_cells));
+		size_t nr_runs = run_begin_cells.size() - 1;
+
+		// pass 3: partition points with their morton codes into the runs of a temporary file
+		std::string tmp_file_name = file_name + ".tmp";
+		std::fstream tmp(tmp_file_name, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!tmp) {
+			log << "could not create temporary file " << tmp_file_name << std::endl;
+			return false;
+		}
+		size_t run_buffer_size = std::max(std::min(size_t(4096), memory_budget / (4 * nr_runs * sizeof(record))), size_t(64));
+		std::vector<std::vector<record>> run_buffers(nr_runs);
+		std::vector<uint64_t> run_write_positions(nr_runs);
+		for (size_t r = 0; r < nr_runs; ++r)
+			run_write_positions[r] = cell_offsets[run_begin_cells[r]];
+		auto flush_run = [&](size_t r) {
+			auto& B = run_buffers[r];
+			tmp.seekp(std::streamoff(run_write_positions[r] * sizeof(record)));
+			tmp.write(reinterpret_cast<const char*>(B.data()), std::streamsize(B.size() * sizeof(record)));
+			run_write_positions[r] += B.size();
+			B.clear();
+		};
+		source.restart();
+		while (source.read_chunk(chunk, chunk_size)) {
+			codes.resize(chunk.size());
+			point_octree::compute_morton_codes(domain, chunk.data(), chunk.size(), codes.data());
+			for (size_t pi = 0; pi < chunk.size(); ++pi) {
+				uint32_t r = cell_runs[codes[pi] >> cell_shift];
+				run_buffers[r].push_back({ codes[pi], chunk[pi] });
+				if (run_buffers[r].size() == run_buffer_size)
+					flush_run(r);
+			}
+		}
+		for (size_t r = 0; r < nr_runs; ++r)
+			if (!run_buffers[r].empty())
+				flush_run(r);
+		run_buffers.clear();
+		cell_runs.clear();
+		cell_runs.shrink_to_fit();
+		if (!tmp) {
+			log << "could not write temporary file " << tmp_file_name << std::endl;
+			return false;
+		}
+
+		// construct the node hierarchy above the histogram level
+		nodes.assign(1, node(0, 0, uint32_t(nr_points)));
+		deferred_cells.clear();
+		construct_skeleton_node(0, 0);
+
+		// pass 4: sort runs by morton code, append their points to the octree file and construct the subtrees of deferred cells
+		std::ofstream os(file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!os) {
+			log << "could not create " << file_name << std::endl;
+			std::remove(tmp_file_name.c_str());
+			return false;
+		}
+		os.seekp(std::streamoff(points_offset));
+		std::vector<record> run_records;
+		point_octree subtree;
+		size_t di = 0;
+		for (size_t r = 0; r < nr_runs; ++r) {
+			uint32_t run_begin = cell_offsets[run_begin_cells[r]], run_end = cell_offsets[run_begin_cells[r + 1]];
+			if (run_begin == run_end)
+				continue;
+			run_records.resize(run_end - run_begin);
+			tmp.seekg(std::streamoff(uint64_t(run_begin) * sizeof(record)));
+			tmp.read(reinterpret_cast<char*>(run_records.data()), std::streamsize(run_records.size() * sizeof(record)));
+			std::stable_sort(run_records.begin(), run_records.end(), [](const record& a, const record& b) { return a.code < b.code; });
+			chunk.resize(run_records.size());
+			for (size_t pi = 0; pi < run_records.size(); ++pi)
+				chunk[pi] = run_records[pi].point;
+			os.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(chunk.size() * sizeof(cgv::vec3)));
+			for (; di < deferred_cells.size() && deferred_cells[di].second < run_begin_cells[r + 1]; ++di) {
+				node_index_type ni = deferred_cells[di].first;
+				uint32_t cell_begin = cell_offsets[deferred_cells[di].second], cell_end = cell_offsets[deferred_cells[di].second + 1];
+				subtree.morton_indices.resize(cell_end - cell_begin);
+				for (uint32_t pi = cell_begin; pi < cell_end; ++pi)
+					subtree.morton_indices[pi - cell_begin] = run_records[pi - run_begin].code;
+				subtree.nodes.assign(1, node(histogram_level, 0, cell_end - cell_begin));
+				subtree.construct_node(subtree.nodes, 0, max_nr_points_per_leaf);
+				// splice subtree nodes behind current nodes while translating to global point indices
+				node_index_type offset = node_index_type(nodes.size() - 1);
+				for (size_t j = 0; j < subtree.nodes.size(); ++j) {
+					node N = subtree.nodes[j];
+					N.first_point += cell_begin;
+					if (!N.is_leaf())
+						N.first_child += offset;
+					if (j == 0)
+						nodes[ni] = N;
+					else
+						nodes.push_back(N);
+				}
+			}
+		}
+		tmp.close();
+		std::remove(tmp_file_name.c_str());
+
+		out_of_core_octree_header header;
+		std::memcpy(header.magic, "PCOC", 4);
+		header.version = 1;
+		header.nr_points = uint32_t(nr_points);
+		header.nr_nodes = uint32_t(nodes.size());
+		header.max_nr_points_per_leaf = max_nr_points_per_leaf;
+		header.nr_points_per_page = nr_points_per_page;
+		for (unsigned c = 0; c < 3; ++c) {
+			header.domain[c] = domain.get_min_pnt()[c];
+			header.domain[c + 3] = domain.get_max_pnt()[c];
+		}
+		header.points_offset = points_offset;
+		header.nodes_offset = points_offset + nr_points * sizeof(cgv::vec3);
+		os.write(reinterpret_cast<const char*>(nodes.data()), std::streamsize(nodes.size() * sizeof(node)));
+		os.seekp(0);
+		os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (!os) {
+			log << "could not write " << file_name << std::endl;
+			return false;
+		}
+		log << "built out-of-core octree with " << nr_points << " points, " << nodes.size() << " nodes and " << nr_runs << " runs in "
+			<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " sec" << std::endl;
+		nodes.clear();
+		nodes.shrink_to_fit();
+		return true;
+	}
+};
+
+/// octree stored in a file written by out_of_core_octree_builder; the node hierarchy is held in memory while point pages are memory mapped on demand and evicted in least recently used order to stay within the cache budget; not thread safe.
+/// The file stores positions only and serves previews, which extract a subsample of a region into an in-memory point cloud
+class out_of_core_octree
+{
+public:
+	typedef point_octree::node node;
+	typedef octree_base::node_index_type node_index_type;
+	typedef octree_base::point_index_type point_index_type;
+	typedef octree_base::node_ref node_ref;
+	struct cache_statistics
+	{
+		size_t nr_hits = 0;
+		size_t nr_faults = 0;
+		size_t nr_evictions = 0;
+		size_t nr_resident_pages = 0;
+		size_t resident_bytes = 0;
+		size_t peak_resident_bytes = 0;
+	};
+protected:
+	mapped_file file;
+	out_of_core_octree_header header;
+	struct page
+	{
+		const char* data;
+		size_t size;
+		std::list<uint32_t>::iterator lru_position;
+	};
+	std::unordered_map<uint32_t, page> resident_pages;
+	/// indices of resident pages with most recently used page in front
+	std::list<uint32_t> lru_pages;
+	size_t cache_budget;
+	cache_statistics stats;
+	void evict_pages(size_t max_resident_bytes)
+	{
+		while (stats.resident_bytes > max_resident_bytes && !lru_pages.empty()) {
+			auto iter = resident_pages.find(lru_pages.back());
+			file.unmap_view(iter->second.data, iter->second.size);
+			stats.resident_bytes -= iter->second.size;
+			--stats.nr_resident_pages;
+			++stats.nr_evictions;
+			resident_pages.erase(iter);
+			lru_pages.pop_back();
+		}
+	}
+	/// return pointer to the points of page pi, which stays valid until the next page is faulted in
+	const cgv::vec3* fault_in_page(uint32_t pi)
+	{
+		auto iter = resident_pages.find(pi);
+		if (iter != resident_pages.end()) {
+			++stats.nr_hits;
+			lru_pages.splice(lru_pages.begin(), lru_pages, iter->second.lru_position);
+			return reinterpret_cast<const cgv::vec3*>(iter->second.data);
+		}
+		++stats.nr_faults;
+		uint64_t first_point = uint64_t(pi) * header.nr_points_per_page;
+		size_t size = size_t(std::min(uint64_t(header.nr_points_per_page), header.nr_points - first_point) * sizeof(cgv::vec3));
+		evict_pages(cache_budget > size ? cache_budget - size : 0);
+		const char* data = file.map_view(header.points_offset + first_point * sizeof(cgv::vec3), size);
+		if (!data)
+			return 0;
+		lru_pages.push_front(pi);
+		resident_pages[pi] = { data, size, lru_pages.begin() };
+		stats.resident_bytes += size;
+		++stats.nr_resident_pages;
+		stats.peak_resident_bytes = std::max(stats.peak_resident_bytes, stats.resident_bytes);
+		return reinterpret_cast<const cgv::vec3*>(data);
+	}
+	/// collect leaves whose box enlarged by the query margin overlaps region together with whether the enlarged box is contained in region, such that all points of the leaf are inside of region
+	void collect_leaves(const cgv::box3& region, std::vector<std::pair<node_index_type, bool> >& leaves) const
+	{
+		float margin = octree_base::get_query_margin(domain);
+		visit_depth_first([&](const node_ref& nr) {
+			bool contained = true;
+			for (unsigned c = 0; c < 3; ++c) {
+				if (nr.box.get_max_pnt()[c] + margin < region.get_min_pnt()[c] || nr.box.get_min_pnt()[c] - margin > region.get_max_pnt()[c])
+					return false;
+				if (nr.box.get_min_pnt()[c] - margin < region.get_min_pnt()[c] || nr.box.get_max_pnt()[c] + margin > region.get_max_pnt()[c])
+					contained = false;
+			}
+			if (!nodes[nr.node_index].is_leaf())
+				return true;
+			leaves.push_back({ nr.node_index, contained });
+			return false;
+		});
+	}
+	/// call f(first_point, points, nr_points) for consecutive chunks of the points in [begin, end) that each lie in a single page; returns false if a page could not be mapped
+	template <typename F>
+	bool for_each_point_chunk(point_index_type begin, point_index_type end, F f)
+	{
+		while (begin < end) {
+			uint32_t pi = begin / header.nr_points_per_page;
+			const cgv::vec3* page_points = fault_in_page(pi);
+			if (!page_points)
+				return false;
+			point_index_type page_begin = pi * header.nr_points_per_page;
+			point_index_type chunk_end = point_index_type(std::min(uint64_t(end), uint64_t(page_begin) + header.nr_points_per_page));
+			f(begin, page_points + (begin - page_begin), chunk_end - begin);
+			begin = chunk_end;
+		}
+		return true;
+	}
+	size_t get_page_size() const { return is_open() ? size_t(header.nr_points_per_page) * sizeof(cgv::vec3) : 0; }
+public:
+	cgv::box3 domain;
+	std::vector<node> nodes;
+	out_of_core_octree() : cache_budget(size_t(256) << 20) { header.nr_points = 0; }
+	~out_of_core_octree() { close(); }
+	/// open octree file by reading header and nodes, points are mapped on demand
+	bool open(const std::string& file_name)
+	{
+		close();
+		std::ifstream is(file_name, std::ios::in | std::ios::binary);
+		if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::strncmp(header.magic, "PCOC", 4) != 0 || header.version != 1) {
+			header.nr_points = 0;
+			return false;
+		}
+		nodes.resize(header.nr_nodes);
+		is.seekg(std::streamoff(header.nodes_offset));
+		if (!is.read(reinterpret_cast<char*>(nodes.data()), std::streamsize(nodes.size() * sizeof(node))) || !file.open(file_name)) {
+			nodes.clear();
+			header.nr_points = 0;
+			return false;
+		}
+		domain = cgv::box3(cgv::vec3(header.domain[0], header.domain[1], header.domain[2]), cgv::vec3(header.domain[3], header.domain[4], header.domain[5]));
+		cache_budget = std::max(cache_budget, get_page_size());
+		return true;
+	}
+	void close()
+	{
+		evict_pages(0);
+		file.close();
+		nodes.clear();
+		header.nr_points = 0;
+	}
+	bool is_open() const { return file.is_open(); }
+	point_index_type get_nr_points() const { return header.nr_points; }
+	/// set the maximum number of bytes of mapped point pages, which is raised to the page size of the open file if smaller, such that mapped pages never exceed the budget
+	void set_cache_budget(size_t nr_bytes) { cache_budget = std::max(nr_bytes, get_page_size()); evict_pages(cache_budget); }
+	size_t get_cache_budget() const { return cache_budget; }
+	const cache_statistics& get_cache_statistics() const { return stats; }
+	void reset_cache_statistics()
+	{
+		stats.nr_hits = stats.nr_faults = stats.nr_evictions = 0;
+		stats.peak_resident_bytes = stats.resident_bytes;
+	}
+	node_ref get_root_ref() const { return { 0, domain, 0 }; }
+	/// call visitor(const node_ref&) on all nodes in depth first pre-order; the subtree of a node is skipped if the visitor returns false
+	template <typename visitor_type>
+	void visit_depth_first(visitor_type visitor) const
+	{
+		if (nodes.empty())
+			return;
+		node_ref stack[8 * octree_base::max_depth + 1];
+		unsigned stack_size = 0;
+		stack[stack_size++] = get_root_ref();
+		while (stack_size > 0) {
+			node_ref nr = stack[--stack_size];
+			if (!visitor(nr))
+				continue;
+			const node& N = nodes[nr.node_index];
+			for (unsigned ci = 8; ci > 0; --ci) {
+				node_index_type child_index = N.get_child(ci - 1);
+				if (child_index != octree_base::invalid_node_index)
+					stack[stack_size++] = { child_index, octree_base::child_box(nr.box, ci - 1), nr.level + 1 };
+			}
+		}
+	}
+	/// extract a uniform subsample of min(max_nr_points, n) of the n points inside of region, where selecting the r-th inside point if floor((r+1) * max_nr_points / n) > floor(r * max_nr_points / n) fills the budget exactly;
+	/// only the pages of leaves crossing the boundary of region, whose inside points have to be counted, and the pages of sampled points are faulted in
+	void extract_points(const cgv::box3& region, size_t max_nr_points, std::vector<cgv::vec3>& points)
+	{
+		points.clear();
+		std::vector<std::pair<node_index_type, bool> > leaves;
+		collect_leaves(region, leaves);
+		uint64_t n = 0;
+		for (const auto& leaf : leaves) {
+			const node& N = nodes[leaf.first];
+			if (leaf.second)
+				n += N.nr_points;
+			else
+				for_each_point_chunk(N.first_point, N.first_point + N.nr_points, [&](point_index_type, const cgv::vec3* chunk, point_index_type m) {
+					for (point_index_type i = 0; i < m; ++i)
+						if (region.inside(chunk[i]))
+							++n;
+				});
+		}
+		if (n == 0 || max_nr_points == 0)
+			return;
+		uint64_t M = std::min(uint64_t(max_nr_points), n);
+		points.reserve(size_t(M));
+		// rank of the next inside point and rank of the next sample, which is the k-th sample at rank ceil((k+1) * n / M) - 1
+		uint64_t r = 0, k = 0, next_sample = (n + M - 1) / M - 1;
+		auto advance_sample = [&]() { ++k; next_sample = ((k + 1) * n + M - 1) / M - 1; };
+		for (const auto& leaf : leaves) {
+			const node& N = nodes[leaf.first];
+			if (leaf.second) {
+				// samples of contained leaves are located by rank without looking at the other points
+				while (k < M && next_sample < r + N.nr_points) {
+					point_index_type i = N.first_point + point_index_type(next_sample - r);
+					for_each_point_chunk(i, i + 1, [&](point_index_type, const cgv::vec3* chunk, point_index_type) { points.push_back(chunk[0]); });
+					advance_sample();
+				}
+				r += N.nr_points;
+			}
+			else
+				for_each_point_chunk(N.first_point, N.first_point + N.nr_points, [&](point_index_type, const cgv::vec3* chunk, point_index_type m) {
+					for (point_index_type i = 0; i < m; ++i)
+						if (region.inside(chunk[i])) {
+							if (k < M && r == next_sample) {
+								points.push_back(chunk[i]);
+								advance_sample();
+							}
+							++r;
+						}
+				});
+		}
+	}
+};
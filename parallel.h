@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// return the number of threads to be used for a requested number of threads, where 0 selects all hardware threads
+inline unsigned get_nr_threads(unsigned nr_threads_requested = 0)
+{
+	if (nr_threads_requested > 0)
+		return nr_threads_requested;
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+/// pool of persistent worker threads with one task deque per worker, where a worker takes tasks from the back of its own deque and steals from the front of the other deques once its own runs empty;
+/// threads waiting for their tasks to finish execute pending tasks in the meantime, such that tasks may submit and wait for nested tasks without deadlocking the pool
+class thread_pool
+{
+public:
+	typedef std::function<void()> task_type;
+protected:
+	struct task_queue
+	{
+		std::mutex mutex;
+		std::deque<task_type> tasks;
+	};
+	std::vector<std::unique_ptr<task_queue> > queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> nr_queued_tasks;
+	std::atomic<size_t> next_queue;
+	std::mutex sleep_mutex;
+	std::condition_variable wake_up;
+	/// index of the worker executing on the calling thread or -1 for threads outside of the pool
+	static int& current_worker_index() { thread_local int index = -1; return index; }
+	bool pop_task(size_t qi, bool from_back, task_type& t)
+	{
+		task_queue& q = *queues[qi];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (q.tasks.empty())
+			return false;
+		if (from_back) {
+			t = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+		else {
+			t = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+		--nr_queued_tasks;
+		return true;
+	}
+	void work(int wi)
+	{
+		current_worker_index() = wi;
+		for (;;) {
+			if (run_pending_task())
+				continue;
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			wake_up.wait(lock, [this]() { return nr_queued_tasks > 0; });
+		}
+	}
+	thread_pool() : nr_queued_tasks(0), next_queue(0)
+	{
+		unsigned nr_workers = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		for (unsigned wi = 0; wi < nr_workers; ++wi)
+			queues.emplace_back(new task_queue);
+		for (unsigned wi = 0; wi < nr_workers; ++wi)
+			workers.emplace_back([this, wi]() { work(int(wi)); });
+	}
+public:
+	/// return the pool shared by all parallel helpers, which is started on first use and never destroyed such that process exit does not wait for its workers
+	static thread_pool& instance()
+	{
+		static thread_pool* pool = new thread_pool;
+		return *pool;
+	}
+	/// queue a task on the deque of the calling worker or, for threads outside of the pool, on the deques of the workers in turn
+	void submit(task_type t)
+	{
+		int wi = current_worker_index();
+		size_t qi = wi >= 0 ? size_t(wi) : next_queue++ % queues.size();
+		{
+			std::lock_guard<std::mutex> lock(queues[qi]->mutex);
+			queues[qi]->tasks.push_back(std::move(t));
+			++nr_queued_tasks;
+		}
+		// taking the sleep mutex orders the wake up after the check of sleeping workers
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		wake_up.notify_one();
+	}
+	/// execute one pending task, preferring the newest task of the calling worker over the oldest task of another deque, and return whether a task was found
+	bool run_pending_task()
+	{
+		if (nr_queued_tasks == 0)
+			return false;
+		int wi = current_worker_index();
+		task_type t;
+		bool found = wi >= 0 && pop_task(size_t(wi), true, t);
+		for (size_t i = 0; !found && i < queues.size(); ++i)
+			found = pop_task((size_t(wi + 1) + i) % queues.size(), false, t);
+		if (!found)
+			return false;
+		t();
+		return true;
+	}
+};
+
+/// execute f(task_index) for all tasks on the shared thread pool; each participating thread pulls the next unprocessed task from a shared counter such that tasks of uneven size are balanced dynamically,
+/// and the calling thread takes part and executes other pending tasks of the pool until all participants are done
+template <typename F>
+void parallel_tasks(size_t nr_tasks, F f, unsigned nr_threads = 0)
+{
+	nr_threads = unsigned(std::min(size_t(get_nr_threads(nr_threads)), nr_tasks));
+	if (nr_threads <= 1) {
+		for (size_t ti = 0; ti < nr_tasks; ++ti)
+			f(ti);
+		return;
+	}
+	std::atomic<size_t> next_task(0);
+	unsigned nr_running = nr_threads;
+	std::mutex done_mutex;
+	std::condition_variable done;
+	auto participate = [&]() {
+		size_t ti;
+		while ((ti = next_task++) < nr_tasks)
+			f(ti);
+		std::lock_guard<std::mutex> lock(done_mutex);
+		if (--nr_running == 0)
+			done.notify_all();
+	};
+	thread_pool& pool = thread_pool::instance();
+	for (unsigned i = 1; i < nr_threads; ++i)
+		pool.submit(participate);
+	participate();
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(done_mutex);
+			if (nr_running == 0)
+				return;
+		}
+		if (pool.run_pending_task())
+			continue;
+		// participants still queued are run by the pool or by this thread after a short wait
+		std::unique_lock<std::mutex> lock(done_mutex);
+		done.wait_for(lock, std::chrono::microseconds(100), [&]() { return nr_running == 0; });
+	}
+}
+
+/// return the number of blocks a range of n elements is split into when processed with the given number of threads
+inline size_t get_nr_blocks(size_t n, unsigned nr_threads = 0, size_t min_block_size = 4096)
+{
+	size_t nr_blocks = std::min(size_t(4 * get_nr_threads(nr_threads)), (n + min_block_size - 1) / min_block_size);
+	return std::max(nr_blocks, size_t(1));
+}
+
+/// split the index range [begin,end) into nr_blocks consecutive blocks and execute f(block_index, block_begin, block_end) in parallel
+template <typename F>
+void parallel_blocks(size_t begin, size_t end, size_t nr_blocks, F f, unsigned nr_threads = 0)
+{
+	size_t n = end - begin;
+	parallel_tasks(nr_blocks, [&](size_t bi) {
+		f(bi, begin + bi * n / nr_blocks, begin + (bi + 1) * n / nr_blocks);
+	}, nr_threads);
+}
+
+/// execute f(block_begin, block_end) over the index range [begin,end) in parallel
+template <typename F>
+void parallel_for(size_t begin, size_t end, F f, unsigned nr_threads = 0, size_t min_block_size = 4096)
+{
+	parallel_blocks(begin, end, get_nr_blocks(end - begin, nr_threads, min_block_size), [&](size_t, size_t b, size_t e) { f(b, e); }, nr_threads);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "parallel.h"
+
+/// compute the permutation perm of a stable counting sort of n elements by their class get_class(i) in [0,nr_classes), such that element i moves to position perm[i];
+/// each block of elements is histogrammed in parallel, prefix sums over classes and blocks give the first position of each class in each block and blocks scatter their elements in parallel;
+/// class_counts is set to the number of elements per class
+template <typename index_type, typename class_accessor_type>
+void compute_counting_sort_permutation(size_t n, unsigned nr_classes, class_accessor_type get_class, std::vector<index_type>& perm, std::vector<size_t>& class_counts, unsigned nr_threads = 0)
+{
+	size_t nr_blocks = get_nr_blocks(n, nr_threads);
+	std::vector<size_t> offsets(nr_blocks * nr_classes, 0);
+	parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		size_t* histogram = &offsets[bi * nr_classes];
+		for (size_t i = b; i < e; ++i)
+			++histogram[get_class(i)];
+	}, nr_threads);
+	class_counts.assign(nr_classes, 0);
+	size_t sum = 0;
+	for (unsigned c = 0; c < nr_classes; ++c)
+		for (size_t bi = 0; bi < nr_blocks; ++bi) {
+			size_t cnt = offsets[bi * nr_classes + c];
+			offsets[bi * nr_classes + c] = sum;
+			sum += cnt;
+			class_counts[c] += cnt;
+		}
+	perm.resize(n);
+	parallel_blocks(0, n, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		size_t* next = &offsets[bi * nr_classes];
+		for (size_t i = b; i < e; ++i)
+			perm[i] = index_type(next[get_class(i)]++);
+	}, nr_threads);
+}
+
+/// move data[i] to data[perm[i]] for all n elements by scattering into a temporary copy of the array in parallel and copying it back in parallel
+template <typename T, typename index_type>
+void permute_in_blocks(T* data, size_t n, const std::vector<index_type>& perm, unsigned nr_threads = 0)
+{
+	std::vector<T> permuted(n);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			permuted[perm[i]] = data[i];
+	}, nr_threads);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		std::copy(permuted.begin() + b, permuted.begin() + e, data + b);
+	}, nr_threads);
+}
+
+/// move data[i] to data[perm[i]] for all n elements without a second copy of the array by following the cycles of perm, which needs one bit per element to mark processed elements
+template <typename T, typename index_type>
+void permute_in_place(T* data, size_t n, const std::vector<index_type>& perm)
+{
+	std::vector<bool> done(n, false);
+	for (size_t i = 0; i < n; ++i) {
+		if (done[i])
+			continue;
+		// carry the element of the cycle start along the cycle until it closes
+		T carried = data[i];
+		size_t j = size_t(perm[i]);
+		while (j != i) {
+			std::swap(carried, data[j]);
+			done[j] = true;
+			j = size_t(perm[j]);
+		}
+		data[i] = carried;
+		done[i] = true;
+	}
+}
+
+/// move data[i] to data[perm[i]] for all n elements either in place or in parallel through a temporary copy
+template <typename T, typename index_type>
+void permute_array(T* data, size_t n, const std::vector<index_type>& perm, bool in_place, unsigned nr_threads = 0)
+{
+	if (in_place)
+		permute_in_place(data, n, perm);
+	else
+		permute_in_blocks(data, n, perm, nr_threads);
+}
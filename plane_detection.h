@@ -0,0 +1,492 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cgv/math/fvec.h>
+#include "morton.h"
+#include "octrees.h"
+#include "parallel.h"
+
+/// structure of arrays copy of point positions, which allows vectorized plane distance tests over contiguous memory
+struct point_soa
+{
+	std::vector<float> x, y, z;
+	/// copy the points referenced by n indices in parallel
+	void assign(const cgv::vec3* points_ptr, const uint32_t* indices, size_t n, unsigned nr_threads = 0)
+	{
+		x.resize(n);
+		y.resize(n);
+		z.resize(n);
+		parallel_for(0, n, [&](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				const cgv::vec3& p = points_ptr[indices[i]];
+				x[i] = p[0];
+				y[i] = p[1];
+				z[i] = p[2];
+			}
+		}, nr_threads);
+	}
+	size_t size() const { return x.size(); }
+	void resize(size_t n)
+	{
+		x.resize(n);
+		y.resize(n);
+		z.resize(n);
+	}
+	void swap_points(size_t i, size_t j)
+	{
+		std::swap(x[i], x[j]);
+		std::swap(y[i], y[j]);
+		std::swap(z[i], z[j]);
+	}
+};
+
+// distances are evaluated without fused multiply adds, such that all kernels classify points identically also when the compiler targets fma
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC push_options
+#	pragma GCC optimize("fp-contract=off")
+#endif
+
+/// plane hypothesis given by a point on the plane and the unit normal
+struct plane_hypothesis
+{
+	cgv::vec3 p0, nml;
+	/// return whether point lies closer than eps to plane; all kernels evaluate the distance with the same operations in the same order and therefore classify points identically
+	bool is_inlier(float x, float y, float z, float eps) const
+	{
+#ifdef __clang__
+#	pragma clang fp contract(off)
+#endif
+		float d = (x - p0[0]) * nml[0] + (y - p0[1]) * nml[1] + (z - p0[2]) * nml[2];
+		return std::fabs(d) < eps;
+	}
+};
+
+inline size_t count_plane_inliers_scalar(const plane_hypothesis& h, const float* x, const float* y, const float* z, size_t n, float eps)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i)
+		if (h.is_inlier(x[i], y[i], z[i], eps))
+			++count;
+	return count;
+}
+
+#ifdef MORTON_X86
+/// inliers are counted by subtracting the all ones comparison masks from integer lane counters
+inline size_t count_plane_inliers_sse2(const plane_hypothesis& h, const float* x, const float* y, const float* z, size_t n, float eps)
+{
+	const __m128 p0x = _mm_set1_ps(h.p0[0]), p0y = _mm_set1_ps(h.p0[1]), p0z = _mm_set1_ps(h.p0[2]);
+	const __m128 nx = _mm_set1_ps(h.nml[0]), ny = _mm_set1_ps(h.nml[1]), nz = _mm_set1_ps(h.nml[2]);
+	const __m128 sign_mask = _mm_set1_ps(-0.0f), e = _mm_set1_ps(eps);
+	__m128i counts = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 d = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), p0x), nx),
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + i), p0y), ny)),
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z + i), p0z), nz));
+		__m128 inlier = _mm_cmplt_ps(_mm_andnot_ps(sign_mask, d), e);
+		counts = _mm_sub_epi32(counts, _mm_castps_si128(inlier));
+	}
+	uint32_t lanes[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), counts);
+	return size_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3] + count_plane_inliers_scalar(h, x + i, y + i, z + i, n - i, eps);
+}
+MORTON_TARGET("avx2") inline size_t count_plane_inliers_avx2(const plane_hypothesis& h, const float* x, const float* y, const float* z, size_t n, float eps)
+{
+	const __m256 p0x = _mm256_set1_ps(h.p0[0]), p0y = _mm256_set1_ps(h.p0[1]), p0z = _mm256_set1_ps(h.p0[2]);
+	const __m256 nx = _mm256_set1_ps(h.nml[0]), ny = _mm256_set1_ps(h.nml[1]), nz = _mm256_set1_ps(h.nml[2]);
+	const __m256 sign_mask = _mm256_set1_ps(-0.0f), e = _mm256_set1_ps(eps);
+	__m256i counts = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 d = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), p0x), nx),
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(y + i), p0y), ny)),
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z + i), p0z), nz));
+		__m256 inlier = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, d), e, _CMP_LT_OQ);
+		counts = _mm256_sub_epi32(counts, _mm256_castps_si256(inlier));
+	}
+	uint32_t lanes[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), counts);
+	size_t count = 0;
+	for (unsigned j = 0; j < 8; ++j)
+		count += lanes[j];
+	return count + count_plane_inliers_scalar(h, x + i, y + i, z + i, n - i, eps);
+}
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC pop_options
+#endif
+
+/// count inliers of a plane hypothesis among the points [begin, end) of P on the calling thread, where use_simd selects the widest vector kernel supported by the cpu
+inline size_t count_plane_inliers_block(const plane_hypothesis& h, const point_soa& P, size_t begin, size_t end, float eps, bool use_simd)
+{
+	const float* x = P.x.data() + begin, *y = P.y.data() + begin, *z = P.z.data() + begin;
+#ifdef MORTON_X86
+	if (use_simd) {
+		static const bool has_avx2 = morton_backend_supported(MB_AVX2);
+		return has_avx2 ? count_plane_inliers_avx2(h, x, y, z, end - begin, eps) : count_plane_inliers_sse2(h, x, y, z, end - begin, eps);
+	}
+#endif
+	return count_plane_inliers_scalar(h, x, y, z, end - begin, eps);
+}
+
+/// count inliers of a plane hypothesis among the points [begin, end) of P, where the range is split into blocks that are scored in parallel
+inline size_t count_plane_inliers(const plane_hypothesis& h, const point_soa& P, size_t begin, size_t end, float eps, bool use_simd = true, unsigned nr_threads = 0)
+{
+	size_t nr_blocks = get_nr_blocks(end - begin, nr_threads, 65536);
+	if (nr_blocks == 1)
+		return count_plane_inliers_block(h, P, begin, end, eps, use_simd);
+	std::vector<size_t> block_counts(nr_blocks);
+	parallel_blocks(begin, end, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		block_counts[bi] = count_plane_inliers_block(h, P, b, e, eps, use_simd);
+	}, nr_threads);
+	size_t count = 0;
+	for (size_t c : block_counts)
+		count += c;
+	return count;
+}
+
+/// add the number of inliers of hypothesis j among the points [begin, end) of P to counts[j] for nr_hypotheses hypotheses in one pass over memory:
+/// points are processed in tiles that stay in the l1 cache while all hypotheses are scored against them, and the range is split into blocks that are processed in parallel
+inline void count_plane_inliers_batch(const plane_hypothesis* hypotheses, size_t nr_hypotheses, const point_soa& P, size_t begin, size_t end, float eps, size_t* counts, bool use_simd = true, unsigned nr_threads = 0)
+{
+	static const size_t tile_size = 1024;
+	size_t nr_blocks = get_nr_blocks(end - begin, nr_threads, 16384);
+	std::vector<size_t> block_counts(nr_blocks * nr_hypotheses, 0);
+	parallel_blocks(begin, end, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		size_t* block_count = &block_counts[bi * nr_hypotheses];
+		for (size_t tile_begin = b; tile_begin < e; tile_begin += tile_size) {
+			size_t tile_end = std::min(e, tile_begin + tile_size);
+			for (size_t j = 0; j < nr_hypotheses; ++j)
+				block_count[j] += count_plane_inliers_block(hypotheses[j], P, tile_begin, tile_end, eps, use_simd);
+		}
+	}, nr_threads);
+	for (size_t bi = 0; bi < nr_blocks; ++bi)
+		for (size_t j = 0; j < nr_hypotheses; ++j)
+			counts[j] += block_counts[bi * nr_hypotheses + j];
+}
+
+/// compute the smallest eigenvalue of the symmetric matrix with upper triangle C in the order xx, xy, xz, yy, yz, zz from the trigonometric solution of the characteristic polynomial
+inline double compute_smallest_eigenvalue(const double C[6], double* p_ptr = 0)
+{
+	double q = (C[0] + C[3] + C[5]) / 3;
+	double p1 = C[1] * C[1] + C[2] * C[2] + C[4] * C[4];
+	double p2 = (C[0] - q) * (C[0] - q) + (C[3] - q) * (C[3] - q) + (C[5] - q) * (C[5] - q) + 2 * p1;
+	double p = std::sqrt(p2 / 6);
+	if (p_ptr)
+		*p_ptr = p;
+	if (p < 1e-300)
+		return q;
+	double B[6] = { (C[0] - q) / p, C[1] / p, C[2] / p, (C[3] - q) / p, C[4] / p, (C[5] - q) / p };
+	double r = 0.5 * (B[0] * (B[3] * B[5] - B[4] * B[4]) - B[1] * (B[1] * B[5] - B[4] * B[2]) + B[2] * (B[1] * B[4] - B[3] * B[2]));
+	double phi = std::acos(std::max(-1.0, std::min(1.0, r))) / 3;
+	return q + 2 * p * std::cos(phi + 2.0943951023931957);
+}
+
+/// compute the unit eigenvector of the smallest eigenvalue of the symmetric matrix with upper triangle C and return false if it is not unique
+inline bool compute_smallest_eigenvector(const double C[6], double v[3])
+{
+	double p;
+	double lambda_min = compute_smallest_eigenvalue(C, &p);
+	if (p < 1e-300)
+		return false;
+	// eigenvector is orthogonal to the rows of C - lambda_min I, so take the longest cross product of two rows
+	double R[3][3] = {
+		{ C[0] - lambda_min, C[1], C[2] },
+		{ C[1], C[3] - lambda_min, C[4] },
+		{ C[2], C[4], C[5] - lambda_min } };
+	double best_length = 0;
+	for (unsigned i = 0; i < 3; ++i) {
+		const double* a = R[i], * b = R[(i + 1) % 3];
+		double c[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+		double length = std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+		if (length > best_length) {
+			best_length = length;
+			for (unsigned j = 0; j < 3; ++j)
+				v[j] = c[j] / length;
+		}
+	}
+	return best_length > 1e-12 * p * p;
+}
+
+/// first and second order moments of points relative to a reference point, which are accumulated in double precision per block and merged
+struct plane_fit_moments
+{
+	double n = 0;
+	double s[3] = { 0, 0, 0 };
+	/// products in the order xx, xy, xz, yy, yz, zz
+	double ss[6] = { 0, 0, 0, 0, 0, 0 };
+	void add(double x, double y, double z)
+	{
+		n += 1;
+		s[0] += x; s[1] += y; s[2] += z;
+		ss[0] += x * x; ss[1] += x * y; ss[2] += x * z;
+		ss[3] += y * y; ss[4] += y * z; ss[5] += z * z;
+	}
+	void add(const plane_fit_moments& m)
+	{
+		n += m.n;
+		for (unsigned i = 0; i < 3; ++i)
+			s[i] += m.s[i];
+		for (unsigned i = 0; i < 6; ++i)
+			ss[i] += m.ss[i];
+	}
+	/// compute covariance matrix in the order of ss and the centroid relative to the reference point
+	void compute_covariance(double C[6], double c[3]) const
+	{
+		for (unsigned i = 0; i < 3; ++i)
+			c[i] = s[i] / n;
+		C[0] = ss[0] / n - c[0] * c[0]; C[1] = ss[1] / n - c[0] * c[1]; C[2] = ss[2] / n - c[0] * c[2];
+		C[3] = ss[3] / n - c[1] * c[1]; C[4] = ss[4] / n - c[1] * c[2]; C[5] = ss[5] / n - c[2] * c[2];
+	}
+	/// set h to the least squares plane of the points, whose moments are relative to reference, where the normal keeps the orientation of h.nml; returns false if the fit is degenerate
+	bool fit(const cgv::vec3& reference, plane_hypothesis& h) const
+	{
+		if (n < 3)
+			return false;
+		cgv::vec3 r = reference;
+		double C[6], c[3], v[3];
+		compute_covariance(C, c);
+		if (!compute_smallest_eigenvector(C, v))
+			return false;
+		if (v[0] * h.nml[0] + v[1] * h.nml[1] + v[2] * h.nml[2] < 0)
+			for (unsigned j = 0; j < 3; ++j)
+				v[j] = -v[j];
+		for (unsigned j = 0; j < 3; ++j) {
+			h.p0[j] = float(r[j] + c[j]);
+			h.nml[j] = float(v[j]);
+		}
+		return true;
+	}
+};
+
+/// accumulate moments of the inliers of h among the points [begin, end) of P relative to h.p0; blocks have a fixed size independent of the number of threads such that the result does not depend on it
+inline plane_fit_moments compute_plane_inlier_moments(const plane_hypothesis& h, const point_soa& P, size_t begin, size_t end, float eps, unsigned nr_threads = 0)
+{
+	static const size_t block_size = 65536;
+	size_t nr_blocks = std::max(size_t(1), (end - begin + block_size - 1) / block_size);
+	std::vector<plane_fit_moments> block_moments(nr_blocks);
+	parallel_blocks(begin, end, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		plane_fit_moments& m = block_moments[bi];
+		for (size_t i = b; i < e; ++i)
+			if (h.is_inlier(P.x[i], P.y[i], P.z[i], eps))
+				m.add(double(P.x[i]) - h.p0[0], double(P.y[i]) - h.p0[1], double(P.z[i]) - h.p0[2]);
+	}, nr_threads);
+	plane_fit_moments moments;
+	for (const auto& m : block_moments)
+		moments.add(m);
+	return moments;
+}
+
+/// replace h by the least squares plane through its inliers among the points [begin, end) of P, which passes through their centroid and is oriented like h; returns false if the fit is degenerate
+inline bool fit_plane_to_inliers(plane_hypothesis& h, const point_soa& P, size_t begin, size_t end, float eps, unsigned nr_threads = 0)
+{
+	return compute_plane_inlier_moments(h, P, begin, end, eps, nr_threads).fit(h.p0, h);
+}
+
+/// stably partition the points [begin, end) of P together with the indices I such that the inliers of h come first and return their number;
+/// inliers are counted per block, after which blocks scatter in parallel to offsets from a prefix sum in the scratch buffers, which are copied back
+inline size_t partition_plane_inliers(const plane_hypothesis& h, point_soa& P, uint32_t* I, size_t begin, size_t end, float eps,
+	point_soa& scratch, std::vector<uint32_t>& scratch_indices, bool use_simd = true, unsigned nr_threads = 0)
+{
+	size_t n = end - begin;
+	size_t nr_blocks = get_nr_blocks(n, nr_threads, 65536);
+	std::vector<size_t> inlier_offsets(nr_blocks + 1, 0);
+	parallel_blocks(begin, end, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		inlier_offsets[bi + 1] = count_plane_inliers_block(h, P, b, e, eps, use_simd);
+	}, nr_threads);
+	for (size_t bi = 0; bi < nr_blocks; ++bi)
+		inlier_offsets[bi + 1] += inlier_offsets[bi];
+	size_t nr_inliers = inlier_offsets[nr_blocks];
+	scratch.resize(n);
+	scratch_indices.resize(n);
+	parallel_blocks(begin, end, nr_blocks, [&](size_t bi, size_t b, size_t e) {
+		size_t inlier_pos = inlier_offsets[bi];
+		size_t outlier_pos = nr_inliers + (b - begin) - inlier_offsets[bi];
+		for (size_t i = b; i < e; ++i) {
+			size_t j = h.is_inlier(P.x[i], P.y[i], P.z[i], eps) ? inlier_pos++ : outlier_pos++;
+			scratch.x[j] = P.x[i];
+			scratch.y[j] = P.y[i];
+			scratch.z[j] = P.z[i];
+			scratch_indices[j] = I[i];
+		}
+	}, nr_threads);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		std::copy(scratch.x.begin() + b, scratch.x.begin() + e, P.x.begin() + begin + b);
+		std::copy(scratch.y.begin() + b, scratch.y.begin() + e, P.y.begin() + begin + b);
+		std::copy(scratch.z.begin() + b, scratch.z.begin() + e, P.z.begin() + begin + b);
+		std::copy(scratch_indices.begin() + b, scratch_indices.begin() + e, I + begin + b);
+	}, nr_threads);
+	return nr_inliers;
+}
+
+/// return an upper bound of the number of inliers among n points in random order, that holds with high probability if nr_subset_inliers inliers were found among the first m points;
+/// the bound lies three standard deviations above the extrapolated count
+inline double estimate_max_nr_inliers(size_t nr_subset_inliers, size_t m, size_t n)
+{
+	if (m >= n)
+		return double(nr_subset_inliers);
+	double f = double(n) / m, s = double(nr_subset_inliers);
+	return f * (s + 3.0 * std::sqrt(s * (1.0 - 1.0 / f) + 1.0));
+}
+
+/// draws the second and third point of a plane hypothesis from the octree cell that contains the first point at a randomly chosen level, as in efficient ransac of Schnabel et al.,
+/// which makes all inlier triples of small planes far more likely than drawing all points from the whole cloud
+struct localized_sampler
+{
+	typedef octree_base::node_ref node_ref;
+	typedef octree_base::point_index_type point_index_type;
+	const octree_base* octree_ptr = 0;
+	const cgv::vec3* points_ptr = 0;
+	/// number of levels below the root
+	unsigned depth = 0;
+	/// nodes from the root to the leaf of the last first point
+	std::vector<node_ref> path;
+	void init(const octree_base& octree, const cgv::vec3* _points_ptr)
+	{
+		octree_ptr = &octree;
+		points_ptr = _points_ptr;
+		depth = 0;
+		octree.visit_depth_first([this](const node_ref& nr) { depth = std::max(depth, nr.level); return true; });
+	}
+	/// probability to draw an all inlier triple of a compact plane with the given fraction of inliers, which is inlier_fraction / (4 * depth) for uniformly chosen levels
+	double get_probability(double inlier_fraction) const { return inlier_fraction / (4.0 * std::max(depth, 1u)); }
+	/// fill path with the nodes from the root to the leaf containing point pi
+	void compute_path(point_index_type pi)
+	{
+		path.clear();
+		node_ref nr = octree_ptr->get_root_ref(), child;
+		path.push_back(nr);
+		while (!octree_ptr->is_leaf(nr.node_index) && octree_ptr->get_child_ref(nr, octree_base::get_child_index(points_ptr[pi], nr.box.get_center()), child))
+			path.push_back(nr = child);
+	}
+	/// draw a point of the cell nr in at most nr_tries attempts and return whether it is accepted by is_candidate(pi)
+	template <typename engine_type, typename predicate_type>
+	bool draw_point(const node_ref& nr, engine_type& RE, predicate_type is_candidate, point_index_type& pi, unsigned nr_tries = 8) const
+	{
+		point_index_type first_point = octree_ptr->get_first_point(nr.node_index), nr_points = octree_ptr->get_nr_points(nr.node_index);
+		std::uniform_int_distribution<point_index_type> D(first_point, first_point + nr_points - 1);
+		for (unsigned t = 0; t < nr_tries; ++t) {
+			pi = octree_ptr->point_indices[D(RE)];
+			if (is_candidate(pi))
+				return true;
+		}
+		return false;
+	}
+	/// draw points pi1 and pi2 accepted by is_remaining(pi) from the cell of pi0 at a random level below the root, where cells without two further remaining points are replaced by their parents; returns false if not even the root yields them
+	template <typename engine_type, typename predicate_type>
+	bool draw_neighbors(point_index_type pi0, engine_type& RE, predicate_type is_remaining, point_index_type& pi1, point_index_type& pi2)
+	{
+		compute_path(pi0);
+		size_t level = path.size() == 1 ? 0 : std::uniform_int_distribution<size_t>(1, path.size() - 1)(RE);
+		for (size_t l = level + 1; l > 0; --l) {
+			const node_ref& nr = path[l - 1];
+			if (octree_ptr->get_nr_points(nr.node_index) < 3)
+				continue;
+			if (draw_point(nr, RE, [&](point_index_type pi) { return pi != pi0 && is_remaining(pi); }, pi1) &&
+				draw_point(nr, RE, [&](point_index_type pi) { return pi != pi0 && pi != pi1 && is_remaining(pi); }, pi2))
+				return true;
+		}
+		return false;
+	}
+};
+
+/// parameters of a ransac plane detection, which are copied from the gui such that a detection thread never reads members that the gui may change
+struct plane_detection_settings
+{
+	unsigned max_nr_planes = 1000;
+	/// planes need at least the larger of min_nr_points and the inlier_percentage of the remaining points
+	unsigned min_nr_points = 50;
+	float inlier_percentage = 0.1f;
+	/// probability of missing the best plane, which determines the number of iterations
+	float probability_threshold = 0.01f;
+	bool early_termination = true;
+	/// maximum distance of inliers from the plane
+	float eps = 0;
+	bool use_simd = true;
+	unsigned nr_threads = 0;
+	/// number of hypotheses scored together in one pass over the points
+	unsigned batch_size = 64;
+	unsigned nr_refinement_iterations = 3;
+	bool use_localized_sampling = false;
+	bool use_subset_scoring = false;
+	unsigned scoring_subset_size = 16384;
+};
+
+/// state shared between a plane detection running in a background thread and the thread that publishes its planes
+struct plane_detection_job
+{
+	std::thread thread;
+	std::atomic<bool> cancel_requested{ false };
+	std::atomic<bool> finished{ false };
+	/// fraction of the iterations spent on the current plane and fraction of the points assigned to planes
+	std::atomic<float> iteration_progress{ 0.0f };
+	std::atomic<float> point_progress{ 0.0f };
+	/// duration of the detection in seconds, which is set before the thread finishes
+	std::atomic<float> seconds{ 0.0f };
+	std::mutex mutex;
+	/// accepted planes with their inliers that have not been taken yet
+	std::vector<cgv::vec3> centers, normals;
+	std::vector<std::vector<uint32_t>> inliers;
+	~plane_detection_job() { cancel(); }
+	bool is_running() const { return thread.joinable() && !finished; }
+	bool is_cancelled() const { return cancel_requested; }
+	/// start detect in a new thread after cancelling a running job and discarding planes that were not taken
+	void start(std::function<void()> detect)
+	{
+		cancel();
+		centers.clear();
+		normals.clear();
+		inliers.clear();
+		cancel_requested = false;
+		finished = false;
+		iteration_progress = point_progress = seconds = 0.0f;
+		thread = std::thread([this, detect]() { detect(); finished = true; });
+	}
+	/// request cancellation and wait until the detection thread stopped, after which all planes it accepted have been published
+	void cancel()
+	{
+		if (!thread.joinable())
+			return;
+		cancel_requested = true;
+		thread.join();
+	}
+	/// join the detection thread if it has finished and return whether no detection thread is left
+	bool join_finished()
+	{
+		if (thread.joinable() && finished)
+			thread.join();
+		return !thread.joinable();
+	}
+	/// called from the detection thread for each accepted plane with the indices of its inliers
+	void publish(const cgv::vec3& center, const cgv::vec3& normal, const uint32_t* inliers_begin, const uint32_t* inliers_end)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		centers.push_back(center);
+		normals.push_back(normal);
+		inliers.emplace_back(inliers_begin, inliers_end);
+	}
+	/// append published planes to the given vectors and return whether there were any
+	bool take_planes(std::vector<cgv::vec3>& _centers, std::vector<cgv::vec3>& _normals, std::vector<std::vector<uint32_t>>& _inliers)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (centers.empty())
+			return false;
+		_centers.insert(_centers.end(), centers.begin(), centers.end());
+		_normals.insert(_normals.end(), normals.begin(), normals.end());
+		for (auto& pi : inliers)
+			_inliers.push_back(std::move(pi));
+		centers.clear();
+		normals.clear();
+		inliers.clear();
+		return true;
+	}
+};
@@ -2,6 +2,8 @@
 #include <cgv_gl/gl/gl.h>
 #include <cgv_reflect_types/media/axis_aligned_box.h>
 #include <cgv_reflect_types/media/color.h>
+#include <chrono>
+#include <memory>
 #include <random>
 #include <numeric>
 
@@ -14,6 +16,7 @@ plane_tool::plane_tool(point_cloud_viewer_ptr pcv_ptr) : point_cloud_tool(pcv_pt
 	ars.radius_relative_to_length = 0.01f;
 	if (colorize_points)
 		init_colors();
+	cgv::signal::connect(detection_trigger.shoot, this, &plane_tool::poll_plane_detection);
 }
 void plane_tool::ensure_colors()
 {
@@ -23,106 +26,418 @@ void plane_tool::ensure_colors()
 		viewer_ptr->on_point_cloud_change_callback(PCC_COLORS_CREATE);
 	}
 }
-void plane_tool::compute_planes()
+plane_detection_settings plane_tool::get_detection_settings(float eps) const
 {
-	reset_planes();
+	plane_detection_settings settings;
+	settings.max_nr_planes = max_nr_planes;
+	settings.min_nr_points = min_nr_points;
+	settings.inlier_percentage = inlier_percentage;
+	settings.probability_threshold = probability_threshold;
+	settings.early_termination = early_termination;
+	settings.eps = eps;
+	settings.use_simd = vectorize_scoring;
+	settings.nr_threads = scoring_nr_threads;
+	settings.batch_size = hypothesis_batch_size;
+	settings.nr_refinement_iterations = nr_refinement_iterations;
+	settings.use_localized_sampling = localized_sampling;
+	settings.use_subset_scoring = subset_scoring;
+	settings.scoring_subset_size = scoring_subset_size;
+	return settings;
+}
+void plane_tool::detect_planes(const plane_detection_settings& settings, const cgv::vec3* points, unsigned nr_points, const octree_base* sampling_octree_ptr, std::vector<unsigned>& I, std::vector<unsigned>& end_idx, std::vector<cgv::vec3>& centers, std::vector<cgv::vec3>& normals, plane_detection_job* job)
+{
+	const unsigned max_nr_planes = settings.max_nr_planes, min_nr_points = settings.min_nr_points, nr_threads = settings.nr_threads, batch_size = settings.batch_size;
+	const float inlier_percentage = settings.inlier_percentage, probability_threshold = settings.probability_threshold, eps = settings.eps;
+	const bool early_termination = settings.early_termination, use_simd = settings.use_simd, use_subset_scoring = settings.use_subset_scoring;
+	bool use_localized_sampling = settings.use_localized_sampling;
 	std::default_random_engine RE;
-	auto& pc = ref_pc();
-	float eps = inlier_distance*pc.box().get_extent().length();
-	std::vector<unsigned> I(pc.get_nr_points());
+	I.resize(nr_points);
 	std::iota(I.begin(), I.end(), 0);
-
-	std::vector<unsigned> end_idx;
+	end_idx.clear();
+	centers.clear();
+	normals.clear();
+	if (nr_points < 3)
+		return;
+	// remaining points are kept in a structure of arrays that is permuted along with I
+	point_soa P;
+	P.assign(points, I.data(), I.size(), nr_threads);
+	// localized sampling needs an octree over all points and the position of each point in I to test whether it is remaining
+	localized_sampler sampler;
+	std::vector<unsigned> positions;
+	if (use_localized_sampling) {
+		if (sampling_octree_ptr && sampling_octree_ptr->get_nr_indexed_points() == nr_points) {
+			sampler.init(*sampling_octree_ptr, points);
+			positions = I;
+		}
+		else {
+			std::cout << "no octree over all points, falling back to uniform sampling" << std::endl;
+			use_localized_sampling = false;
+		}
+	}
+	auto swap_points = [&](unsigned i, unsigned j) {
+		std::swap(I[i], I[j]);
+		P.swap_points(i, j);
+		if (use_localized_sampling) {
+			positions[I[i]] = i;
+			positions[I[j]] = j;
+		}
+	};
+	// subset scoring needs the remaining points in random order such that each prefix is a random subset
+	if (use_subset_scoring) {
+		for (unsigned i = nr_points - 1; i > 0; --i)
+			swap_points(i, std::uniform_int_distribution<unsigned>(0, i)(RE));
+	}
 	unsigned nr_used_points = 0;
-	while (end_idx.size() < max_nr_planes) {
-		std::uniform_int_distribution<int> D(nr_used_points, pc.get_nr_points() - 1);
-		size_t iteration_count = size_t(ceil(log(probability_threshold) / log(1.0 - inlier_percentage * inlier_percentage * inlier_percentage)));
-		unsigned nr_remaining_points = pc.get_nr_points() - nr_used_points;
-		size_t min_nr_target_points = std::max(unsigned(nr_remaining_points * inlier_percentage), min_nr_points);
-		std::cout << "plane " << plane_centers.size() + 1 << ": iteration_count = " << iteration_count << " on " << nr_remaining_points << " points, min_nr_points = " << min_nr_target_points;
-		std::cout.flush();
-		Pnt p0_max, nml_max;
-		size_t max_nr_inliers = 0;
-		// find plane with largest number of inliers
-		for (size_t i = 0; i < iteration_count; ++i) {
-			// randomly choose three points to construct plane
-			Pnt p0, p1, p2, nml;
-			float len;
-			do {
-				int i0 = D(RE), i1, i2;
+	// randomly choose three points to construct plane
+	auto draw_hypothesis = [&](std::uniform_int_distribution<int>& D) {
+		Pnt p0, p1, p2, nml;
+		float len;
+		do {
+			int i0 = D(RE), i1, i2;
+			octree_base::point_index_type pi1, pi2;
+			if (use_localized_sampling && sampler.draw_neighbors(I[i0], RE, [&](octree_base::point_index_type pi) { return positions[pi] >= nr_used_points; }, pi1, pi2)) {
+				i1 = positions[pi1];
+				i2 = positions[pi2];
+			}
+			else {
 				do {
 					i1 = D(RE);
 				} while (i1 == i0);
 				do {
 					i2 = D(RE);
 				} while (i2 == i0 || i2 == i1);
-				p0 = pc.pnt(I[i0]);
-				p1 = pc.pnt(I[i1]);
-				p2 = pc.pnt(I[i2]);
+			}
+			p0 = points[I[i0]];
+			p1 = points[I[i1]];
+			p2 = points[I[i2]];
 
-				nml = cross(p1 - p0, p2 - p0);
-				len = nml.length();
-			} while (len < 1e-6f);
-			// count number of inliers
-			nml /= len;
-			p0 = 0.33333333333f * (p0 + p1 + p2);
-			size_t nr_inliers = 0;
-			for (unsigned pi = nr_used_points; pi < pc.get_nr_points(); ++pi)
-				if (fabs(dot(pc.pnt(I[pi]) - p0, nml)) < eps)
-					++nr_inliers;
-			if (nr_inliers > max_nr_inliers) {
-				max_nr_inliers = nr_inliers;
-				nml_max = nml;
-				p0_max = p0;
-				if (early_termination && max_nr_inliers >= min_nr_target_points) {
-					std::cout << ", early termination = " << i;
-					break;
+			nml = cross(p1 - p0, p2 - p0);
+			len = nml.length();
+		} while (len < 1e-6f);
+		nml /= len;
+		p0 = 0.33333333333f * (p0 + p1 + p2);
+		return plane_hypothesis{ p0, nml };
+	};
+	// batches are scored in slabs of points, between which hypotheses behind one that reached the target are dropped
+	size_t slab_size = 65536 * size_t(get_nr_threads(nr_threads));
+	std::vector<plane_hypothesis> hypotheses;
+	std::vector<size_t> counts;
+	// buffers of the stable partition of remaining points into inliers and the rest
+	point_soa scratch_points;
+	std::vector<unsigned> scratch_indices;
+
+	while (end_idx.size() < max_nr_planes) {
+		std::uniform_int_distribution<int> D(nr_used_points, nr_points - 1);
+		double sample_probability = use_localized_sampling ? sampler.get_probability(inlier_percentage) : inlier_percentage * inlier_percentage * inlier_percentage;
+		size_t iteration_count = size_t(ceil(log(probability_threshold) / log(1.0 - sample_probability)));
+		unsigned nr_remaining_points = nr_points - nr_used_points;
+		size_t min_nr_target_points = std::max(unsigned(nr_remaining_points * inlier_percentage), min_nr_points);
+		// with subset scoring hypotheses are scored on a random subset first and only confirmed on all remaining points if they can beat the best one
+		size_t subset_end = use_subset_scoring ? std::min(size_t(nr_points), size_t(nr_used_points) + settings.scoring_subset_size) : size_t(nr_points);
+		size_t nr_subset_points = subset_end - nr_used_points;
+		bool score_subsets = subset_end < nr_points;
+		plane_hypothesis h_max;
+		size_t max_nr_inliers = 0;
+		// find plane with largest number of inliers
+		if (batch_size <= 1) {
+			for (size_t i = 0; i < iteration_count; ++i) {
+				if (job) {
+					if (job->is_cancelled())
+						break;
+					job->iteration_progress = float(i) / iteration_count;
+				}
+				plane_hypothesis h = draw_hypothesis(D);
+				if (score_subsets) {
+					size_t nr_subset_inliers = count_plane_inliers(h, P, nr_used_points, subset_end, eps, use_simd, nr_threads);
+					if (estimate_max_nr_inliers(nr_subset_inliers, nr_subset_points, nr_remaining_points) <= max_nr_inliers)
+						continue;
+				}
+				size_t nr_inliers = count_plane_inliers(h, P, nr_used_points, P.size(), eps, use_simd, nr_threads);
+				if (nr_inliers > max_nr_inliers) {
+					max_nr_inliers = nr_inliers;
+					h_max = h;
+					if (early_termination && max_nr_inliers >= min_nr_target_points)
+						break;
 				}
 			}
 		}
-		//std::cout << "max inliers = " << max_nr_inliers << " vs " << pc.get_nr_points() * inlier_percentage << std::endl;
-		//std::cout << "nml_max = " << nml_max << std::endl;
-		//std::cout << "p0_max = " << p0_max << std::endl;
-		std::cout << ", max_nr_inliers = " << max_nr_inliers << std::endl;
-		if (max_nr_inliers >= min_nr_target_points) {
-			for (unsigned pi = nr_used_points; pi < pc.get_nr_points(); ++pi) {
-				if (fabs(dot(pc.pnt(I[pi]) - p0_max, nml_max)) < eps) {
-					if (pi > nr_used_points)
-						std::swap(I[pi], I[nr_used_points]);
-					++nr_used_points;
+		else {
+			bool terminated = false;
+			for (size_t i = 0; i < iteration_count && !terminated; i += batch_size) {
+				if (job) {
+					if (job->is_cancelled())
+						break;
+					job->iteration_progress = float(i) / iteration_count;
 				}
+				size_t nr_hypotheses = std::min(size_t(batch_size), iteration_count - i);
+				std::default_random_engine batch_RE = RE;
+				hypotheses.resize(nr_hypotheses);
+				for (auto& h : hypotheses)
+					h = draw_hypothesis(D);
+				counts.assign(nr_hypotheses, 0);
+				if (score_subsets)
+					count_plane_inliers_batch(hypotheses.data(), nr_hypotheses, P, nr_used_points, subset_end, eps, counts.data(), use_simd, nr_threads);
+				else {
+					// with early termination the first hypothesis that reaches the target is selected, so later ones need not be scored further
+					for (size_t slab_begin = nr_used_points; slab_begin < P.size(); slab_begin += slab_size) {
+						count_plane_inliers_batch(hypotheses.data(), nr_hypotheses, P, slab_begin, std::min(P.size(), slab_begin + slab_size), eps, counts.data(), use_simd, nr_threads);
+						if (early_termination) {
+							for (size_t j = 0; j < nr_hypotheses; ++j) {
+								if (counts[j] >= min_nr_target_points) {
+									nr_hypotheses = j + 1;
+									break;
+								}
+							}
+						}
+					}
+				}
+				// evaluate batch in the order of sequential scoring
+				for (size_t j = 0; j < nr_hypotheses; ++j) {
+					if (score_subsets) {
+						if (estimate_max_nr_inliers(counts[j], nr_subset_points, nr_remaining_points) <= max_nr_inliers)
+							continue;
+						counts[j] = count_plane_inliers(hypotheses[j], P, nr_used_points, P.size(), eps, use_simd, nr_threads);
+					}
+					if (counts[j] > max_nr_inliers) {
+						max_nr_inliers = counts[j];
+						h_max = hypotheses[j];
+						if (early_termination && max_nr_inliers >= min_nr_target_points) {
+							// rewind random engine to its state after drawing hypothesis j
+							RE = batch_RE;
+							for (size_t k = 0; k <= j; ++k)
+								draw_hypothesis(D);
+							terminated = true;
+							break;
+						}
+					}
+				}
+			}
+		}
+		// a cancelled search may have missed the best plane, so it is not accepted
+		if (job && job->is_cancelled())
+			break;
+		if (max_nr_inliers >= min_nr_target_points) {
+			// replace hypothesis by least squares fits to its inliers as long as they do not lose inliers
+			for (unsigned ri = 0; ri < settings.nr_refinement_iterations; ++ri) {
+				plane_hypothesis h = h_max;
+				if (!fit_plane_to_inliers(h, P, nr_used_points, P.size(), eps, nr_threads))
+					break;
+				size_t nr_inliers = count_plane_inliers(h, P, nr_used_points, P.size(), eps, use_simd, nr_threads);
+				if (nr_inliers < max_nr_inliers)
+					break;
+				h_max = h;
+				max_nr_inliers = nr_inliers;
+			}
+			unsigned first_inlier = nr_used_points;
+			nr_used_points += unsigned(partition_plane_inliers(h_max, P, I.data(), nr_used_points, P.size(), eps, scratch_points, scratch_indices, use_simd, nr_threads));
+			if (use_localized_sampling) {
+				parallel_for(first_inlier, I.size(), [&](size_t b, size_t e) {
+					for (size_t i = b; i < e; ++i)
+						positions[I[i]] = unsigned(i);
+				}, nr_threads);
 			}
 			end_idx.push_back(nr_used_points);
-			plane_centers.push_back(p0_max);
-			plane_normals.push_back(nml_max);
+			centers.push_back(h_max.p0);
+			normals.push_back(h_max.nml);
+			if (job) {
+				job->publish(h_max.p0, h_max.nml, I.data() + first_inlier, I.data() + nr_used_points);
+				job->point_progress = float(nr_used_points) / nr_points;
+			}
 		}
 		else
 			break;
 	}
-	if (plane_centers.empty())
-		return;
-	// first create plane colors
-	double cs_step = 1.0/double(plane_centers.size());
-	for (size_t pli = 0; pli < plane_centers.size(); ++pli)
-		plane_colors.push_back(cgv::media::color_scale(cs_step * pli, this->color_scale));
-	// next colorize points
-	if (colorize_points) {
-		for (size_t pi = 0; pi < plane_centers.size(); ++pi) {
-			unsigned i = 0;
-			if (pi > 0)
-				i = end_idx[pi - 1];
-			for (; i < end_idx[pi]; ++i)
-				pc.clr(I[i]) = plane_colors[pi];
+}
+void plane_tool::ensure_sampling_octree()
+{
+	octree_base* point_octree_ptr = get_octree();
+	if (!point_octree_ptr || point_octree_ptr->get_nr_indexed_points() != ref_pc().get_nr_points())
+		build_octree();
+}
+void plane_tool::compute_planes()
+{
+	reset_planes();
+	// the detection thread works on its own copy of the positions and builds its own octree for localized sampling, as the viewer may change or replace points and octree at any time
+	auto& pc = ref_pc();
+	auto points = std::make_shared<std::vector<cgv::vec3> >(pc.get_nr_points() > 0 ? &pc.pnt(0) : 0, pc.get_nr_points() > 0 ? &pc.pnt(0) + pc.get_nr_points() : 0);
+	plane_detection_settings settings = get_detection_settings(inlier_distance * pc.box().get_extent().length());
+	bool use_morton_codes = use_morton_octree, isotropic = ensure_isotropic;
+	unsigned nr_octree_threads = this->nr_threads, max_nr_points_per_octree_leaf = max_nr_points_per_leaf;
+	// accepted planes are handed to the gui thread, which colorizes their inliers
+	detection_job.start([this, points, settings, use_morton_codes, isotropic, nr_octree_threads, max_nr_points_per_octree_leaf]() {
+		std::vector<unsigned> I, end_idx;
+		std::vector<cgv::vec3> centers, normals;
+		auto start = std::chrono::steady_clock::now();
+		unsigned nr_points = unsigned(points->size());
+		const cgv::vec3* points_ptr = points->empty() ? 0 : points->data();
+		std::unique_ptr<octree_base> sampling_octree;
+		if (settings.use_localized_sampling) {
+			if (use_morton_codes)
+				sampling_octree.reset(new point_octree);
+			else
+				sampling_octree.reset(new simple_point_octree);
+			sampling_octree->nr_threads = nr_octree_threads;
+			sampling_octree->construct(points_ptr, nr_points, max_nr_points_per_octree_leaf, isotropic);
 		}
+		detect_planes(settings, points_ptr, nr_points, sampling_octree.get(), I, end_idx, centers, normals, &detection_job);
+		detection_job.seconds = float(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	});
+	detection_trigger.schedule_recuring(0.1);
+}
+void plane_tool::grow_regions()
+{
+	reset_planes();
+	auto& pc = ref_pc();
+	if (pc.get_nr_points() == 0)
+		return;
+	ensure_normals();
+	ensure_neighbor_graph();
+	auto start = std::chrono::steady_clock::now();
+	std::vector<uint32_t> labels, I, end_idx;
+	float max_distance = inlier_distance * pc.box().get_extent().length();
+	float min_cos_angle = float(cos(region_max_angle * 0.017453292519943295));
+	grow_plane_regions(&pc.pnt(0), &pc.nml(0), ref_ng(), pc.get_nr_points(), region_max_curvature, min_cos_angle, max_distance, labels, scoring_nr_threads);
+	extract_plane_regions(&pc.pnt(0), &pc.nml(0), labels, min_nr_points, max_nr_planes, I, end_idx, plane_centers, plane_normals, scoring_nr_threads);
+	region_growing_seconds = float(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	update_member(&region_growing_seconds);
+	std::cout << "grew " << plane_centers.size() << " regions in " << region_growing_seconds << " sec" << std::endl;
+	for (size_t pli = 0; pli < plane_centers.size(); ++pli) {
+		plane_colors.push_back(get_plane_color(pli));
+		if (colorize_points)
+			for (uint32_t i = pli == 0 ? 0 : end_idx[pli - 1]; i < end_idx[pli]; ++i)
+				pc.clr(I[i]) = plane_colors[pli];
+	}
+	if (colorize_points)
 		viewer_ptr->on_point_cloud_change_callback(PCC_COLORS);
+	nr_planes = unsigned(plane_centers.size());
+	update_member(&nr_planes);
+	post_redraw();
+}
+cgv::rgba plane_tool::get_plane_color(size_t pli) const
+{
+	// stepping by the golden ratio spreads colors without knowing the final number of planes
+	return cgv::media::color_scale(fmod(0.618033988749895 * pli, 1.0), this->color_scale);
+}
+void plane_tool::publish_planes()
+{
+	size_t first_plane = plane_centers.size();
+	std::vector<std::vector<uint32_t>> inliers;
+	if (!detection_job.take_planes(plane_centers, plane_normals, inliers))
+		return;
+	auto& pc = ref_pc();
+	for (size_t pli = first_plane; pli < plane_centers.size(); ++pli) {
+		plane_colors.push_back(get_plane_color(pli));
+		if (colorize_points)
+			for (uint32_t pi : inliers[pli - first_plane])
+				if (pi < pc.get_nr_points())
+					pc.clr(pi) = plane_colors[pli];
 	}
+	if (colorize_points)
+		viewer_ptr->on_point_cloud_change_callback(PCC_COLORS);
+	nr_planes = unsigned(plane_centers.size());
+	update_member(&nr_planes);
 	post_redraw();
 }
+void plane_tool::update_detection_progress()
+{
+	detection_iteration_progress = detection_job.iteration_progress;
+	detection_point_progress = detection_job.point_progress;
+	update_member(&detection_iteration_progress);
+	update_member(&detection_point_progress);
+}
+void plane_tool::poll_plane_detection(double t, double dt)
+{
+	publish_planes();
+	update_detection_progress();
+	// planes published between the last take and the end of the thread are taken after joining
+	if (detection_job.join_finished()) {
+		publish_planes();
+		ransac_seconds = detection_job.seconds;
+		update_member(&ransac_seconds);
+		detection_trigger.stop();
+	}
+}
+void plane_tool::cancel_plane_detection()
+{
+	detection_job.cancel();
+	publish_planes();
+	update_detection_progress();
+	ransac_seconds = detection_job.seconds;
+	update_member(&ransac_seconds);
+	detection_trigger.stop();
+}
+void plane_tool::discard_plane_detection()
+{
+	detection_job.cancel();
+	std::vector<cgv::vec3> centers, normals;
+	std::vector<std::vector<uint32_t>> inliers;
+	detection_job.take_planes(centers, normals, inliers);
+	detection_trigger.stop();
+}
+void plane_tool::benchmark_plane_scoring()
+{
+	cancel_plane_detection();
+	if (localized_sampling)
+		ensure_sampling_octree();
+	auto& pc = ref_pc();
+	const cgv::vec3* points_ptr = pc.get_nr_points() > 0 ? &pc.pnt(0) : 0;
+	unsigned nr_points = unsigned(pc.get_nr_points());
+	plane_detection_settings settings = get_detection_settings(inlier_distance * pc.box().get_extent().length());
+	typedef std::chrono::steady_clock clock;
+	auto seconds_since = [](clock::time_point start) { return std::chrono::duration<double>(clock::now() - start).count(); };
+	// sequential scalar scoring, per hypothesis scoring with the selected engine and batched scoring with the selected engine
+	static const char* names[] = { "sequential scalar", "per hypothesis", "batched" };
+	unsigned batch_sizes[3] = { 1, 1, std::max(hypothesis_batch_size, 2u) };
+	std::vector<unsigned> I[3], end_idx[3];
+	std::vector<cgv::vec3> centers[3], normals[3];
+	double times[3];
+	for (unsigned mi = 0; mi < 3; ++mi) {
+		settings.use_simd = mi > 0 && vectorize_scoring;
+		settings.nr_threads = mi > 0 ? scoring_nr_threads : 1;
+		settings.batch_size = batch_sizes[mi];
+		auto start = clock::now();
+		detect_planes(settings, points_ptr, nr_points, get_octree(), I[mi], end_idx[mi], centers[mi], normals[mi], 0);
+		times[mi] = seconds_since(start);
+	}
+	std::cout << "plane scoring benchmark with " << (vectorize_scoring ? "vectorized" : "scalar") << " scoring on " << get_nr_threads(scoring_nr_threads) << " threads and batches of " << batch_sizes[2] << " hypotheses:\n";
+	for (unsigned mi = 0; mi < 3; ++mi) {
+		bool identical = I[mi] == I[0] && end_idx[mi] == end_idx[0] && centers[mi] == centers[0] && normals[mi] == normals[0];
+		std::cout << "  " << names[mi] << ": " << times[mi] << " sec, speedup " << times[0] / times[mi] << ", planes " << (identical ? "identical" : "DIFFER") << "\n";
+	}
+	std::cout << "  batched over per hypothesis speedup " << times[1] / times[2] << std::endl;
+}
+void plane_tool::benchmark_plane_sampling()
+{
+	cancel_plane_detection();
+	ensure_sampling_octree();
+	auto& pc = ref_pc();
+	const cgv::vec3* points_ptr = pc.get_nr_points() > 0 ? &pc.pnt(0) : 0;
+	unsigned nr_points = unsigned(pc.get_nr_points());
+	plane_detection_settings settings = get_detection_settings(inlier_distance * pc.box().get_extent().length());
+	typedef std::chrono::steady_clock clock;
+	static const char* names[] = { "uniform sampling", "localized sampling", "uniform sampling with subset scoring", "localized sampling with subset scoring" };
+	std::vector<unsigned> I, end_idx;
+	std::vector<cgv::vec3> centers, normals;
+	double times[4];
+	std::cout << "plane sampling benchmark with subsets of " << scoring_subset_size << " points:\n";
+	for (unsigned mi = 0; mi < 4; ++mi) {
+		settings.use_localized_sampling = (mi & 1) != 0;
+		settings.use_subset_scoring = (mi & 2) != 0;
+		auto start = clock::now();
+		detect_planes(settings, points_ptr, nr_points, get_octree(), I, end_idx, centers, normals, 0);
+		times[mi] = std::chrono::duration<double>(clock::now() - start).count();
+		std::cout << "  " << names[mi] << ": " << times[mi] << " sec, speedup " << times[0] / times[mi] << ", "
+			<< centers.size() << " planes with " << (end_idx.empty() ? 0 : end_idx.back()) << " points" << std::endl;
+	}
+}
 void plane_tool::reset_planes()
 {
+	cancel_plane_detection();
 	plane_centers.clear();
 	plane_normals.clear();
 	plane_colors.clear();
+	nr_planes = 0;
+	update_member(&nr_planes);
 	if (colorize_points)
 		init_colors();
 	post_redraw();
@@ -137,11 +452,12 @@ void plane_tool::init_colors()
 	}
 }
 
-void plane_tool::colorize_node(octree_base::node_handle nh, const cgv::rgb& color)
+void plane_tool::colorize_node(const octree_base::node_ref& nr, const cgv::rgb& color)
 {
 	auto& pc = ref_pc();
-	octree_base::point_index_type nr_points = point_octree_ptr->node_nr_points(nh);
-	octree_base::point_index_type first_point = point_octree_ptr->node_first_point(nh);
+	octree_base* point_octree_ptr = get_octree();
+	octree_base::point_index_type nr_points = point_octree_ptr->get_nr_points(nr.node_index);
+	octree_base::point_index_type first_point = point_octree_ptr->get_first_point(nr.node_index);
 	for (unsigned i = 0; i < nr_points; ++i)
 		pc.clr(point_octree_ptr->point_indices[first_point + i]) = color;
 }
@@ -152,13 +468,14 @@ void plane_tool::colorize_by_node()
 	auto& pc = ref_pc();
 	for (size_t pi = 0; pi < pc.get_nr_points(); ++pi)
 		pc.clr(pi) = default_point_color;
-	if (point_octree_ptr->node_is_leaf(node_iter))
-		colorize_node(node_iter, cgv::rgb(0.5f, 0.5f, 0.0f));
+	octree_base* point_octree_ptr = get_octree();
+	if (point_octree_ptr->is_leaf(current_node.node_index))
+		colorize_node(current_node, cgv::rgb(0.5f, 0.5f, 0.0f));
 	else {
+		octree_base::node_ref child;
 		for (unsigned ci = 0; ci < 8; ++ci) {
-			octree_base::node_handle nh = point_octree_ptr->copy_node_handle(node_iter);
-			if (point_octree_ptr->node_decent(nh, ci)) {
-				colorize_node(nh, cgv::rgb(((ci & 1) == 0) ? 0.0f : 1.0f, ((ci & 2) == 0) ? 0.0f : 1.0f, ((ci & 4) == 0) ? 0.0f : 1.0f));
+			if (point_octree_ptr->get_child_ref(current_node, ci, child)) {
+				colorize_node(child, cgv::rgb(((ci & 1) == 0) ? 0.0f : 1.0f, ((ci & 2) == 0) ? 0.0f : 1.0f, ((ci & 4) == 0) ? 0.0f : 1.0f));
 			}
 		}
 	}
@@ -202,38 +519,71 @@ void plane_tool::draw(cgv::render::context& ctx)
 	//viewer_ptr->draw_box(ctx, Box(ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * clip_box.get_min_pnt(), ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * clip_box.get_max_pnt()), clip_box_color);
 }
 
-void plane_tool::build_octree()
+void plane_tool::update_memory_report()
 {
+	octree_base* point_octree_ptr = get_octree();
+	octree_nr_nodes = 0;
+	octree_bytes_per_node = octree_bytes_per_point = octree_memory_mb = 0;
 	if (point_octree_ptr) {
-		point_octree_ptr->release_node_handle(node_iter);
-		delete point_octree_ptr;
+		size_t nr_bytes = point_octree_ptr->get_memory_usage();
+		octree_nr_nodes = point_octree_ptr->get_nr_nodes();
+		octree_bytes_per_node = float(point_octree_ptr->get_node_size());
+		if (point_octree_ptr->get_nr_indexed_points() > 0)
+			octree_bytes_per_point = float(double(nr_bytes) / point_octree_ptr->get_nr_indexed_points());
+		octree_memory_mb = float(double(nr_bytes) / (1024 * 1024));
 	}
-	point_octree_ptr = new simple_point_octree;
-	point_octree_ptr->construct(&ref_pc().pnt(0), ref_pc().get_nr_points(), max_nr_points_per_leaf, ensure_isotropic);
-	node_iter = point_octree_ptr->create_root_node_handle();
-	node_index = point_octree_ptr->node_index(node_iter);
+	update_member(&octree_nr_nodes);
+	update_member(&octree_bytes_per_node);
+	update_member(&octree_bytes_per_point);
+	update_member(&octree_memory_mb);
+}
+
+void plane_tool::build_octree()
+{
+	octree_base* point_octree_ptr = point_cloud_tool::build_octree(max_nr_points_per_leaf, use_morton_octree, nr_threads, ensure_isotropic);
+	current_node = point_octree_ptr->get_root_ref();
+	node_index = current_node.node_index;
 	update_member(&node_index);
+	update_memory_report();
 	colorize_by_node();
 	post_redraw();
 }
 
+void plane_tool::benchmark_morton_kernels()
+{
+	for (size_t nr_points = 1000000; nr_points <= 100000000; nr_points *= 10)
+		::benchmark_morton_kernels(std::cout, nr_points);
+}
+
+octree_base* plane_tool::get_navigated_octree()
+{
+	octree_base* point_octree_ptr = get_octree();
+	// the viewer may have replaced the octree since the last navigation
+	if (point_octree_ptr && current_node.node_index >= point_octree_ptr->get_nr_nodes())
+		current_node = point_octree_ptr->get_root_ref();
+	return point_octree_ptr;
+}
+
 void plane_tool::to_root()
 {
+	octree_base* point_octree_ptr = get_octree();
 	if (point_octree_ptr) {
-		point_octree_ptr->release_node_handle(node_iter);
-		node_iter = point_octree_ptr->create_root_node_handle();
-		node_index = point_octree_ptr->node_index(node_iter);
+		current_node = point_octree_ptr->get_root_ref();
+		node_index = current_node.node_index;
 		update_member(&node_index);
+		update_memory_report();
 		colorize_by_node();
 		post_redraw();
 	}
 }
 void plane_tool::to_child(unsigned ci)
 {
+	octree_base* point_octree_ptr = get_navigated_octree();
 	if (point_octree_ptr) {
-		if (!point_octree_ptr->node_is_leaf(node_iter)) {
-			point_octree_ptr->node_decent(node_iter, ci);
-			node_index = point_octree_ptr->node_index(node_iter);
+		octree_base::node_ref child;
+		if (point_octree_ptr->get_child_ref(current_node, ci, child)) {
+			current_node = child;
+			node_index = current_node.node_index;
 			update_member(&node_index);
 			colorize_by_node();
 			post_redraw();
@@ -244,13 +594,18 @@ void plane_tool::to_child(unsigned ci)
 void plane_tool::on_point_cloud_change_callback(PointCloudChangeEvent pcc_event)
 {
 	if ((pcc_event & PCC_POINTS_MASK) != 0) {
+		// inliers of planes that were not published yet may refer to points that no longer exist
+		discard_plane_detection();
 		if (colorize_points)
 			init_colors();
+		// insertion of appended points changes node indices and may enlarge the domain
+		octree_base* point_octree_ptr = get_octree();
 		if (point_octree_ptr) {
-			point_octree_ptr->release_node_handle(node_iter);
-			delete point_octree_ptr;
-			point_octree_ptr = 0;
+			current_node = point_octree_ptr->get_root_ref();
+			node_index = current_node.node_index;
+			update_member(&node_index);
 		}
+		update_memory_report();
 	}
 }
 
@@ -262,17 +617,42 @@ void plane_tool::create_gui()
 	add_member_control(this, "Min Nr Points", min_nr_points, "value_slider", "min=1;max=1000;log=true;ticks=true");
 	add_member_control(this, "Inlier Distance", inlier_distance, "value_slider", "min=.0000001;max=1;step=0.000000001;log=true;ticks=true");
 	add_member_control(this, "Early Termination", early_termination, "toggle");
+	add_member_control(this, "Vectorize Scoring", vectorize_scoring, "toggle");
+	add_member_control(this, "Scoring Threads (0=all)", scoring_nr_threads, "value_slider", "min=0;max=64;ticks=true");
+	add_member_control(this, "Hypothesis Batch Size", hypothesis_batch_size, "value_slider", "min=1;max=256;log=true;ticks=true");
+	add_member_control(this, "Refinement Iterations", nr_refinement_iterations, "value_slider", "min=0;max=10;ticks=true");
+	add_member_control(this, "Localized Sampling", localized_sampling, "toggle");
+	add_member_control(this, "Subset Scoring", subset_scoring, "toggle");
+	add_member_control(this, "Scoring Subset Size", scoring_subset_size, "value_slider", "min=256;max=1000000;log=true;ticks=true");
 	add_member_control(this, "Inlier Percentage", inlier_percentage, "value_slider", "min=0.001;max=1;step=0.0000001;log=true;ticks=true");
 	add_member_control(this, "Probability Threshold", probability_threshold, "value_slider", "min=0.001;max=1;step=0.0000001;log=true;ticks=true");
 	connect_copy(add_button("Find Planes")->click, cgv::signal::rebind(this, &plane_tool::compute_planes));
+	connect_copy(add_button("Cancel")->click, cgv::signal::rebind(this, &plane_tool::cancel_plane_detection));
+	connect_copy(add_button("Grow Regions")->click, cgv::signal::rebind(this, &plane_tool::grow_regions));
+	add_member_control(this, "Region Max Curvature", region_max_curvature, "value_slider", "min=0.0001;max=0.33;step=0.0001;log=true;ticks=true");
+	add_member_control(this, "Region Max Angle", region_max_angle, "value_slider", "min=0.1;max=90;log=true;ticks=true");
+	add_view("RANSAC Time [s]", ransac_seconds);
+	add_view("Region Growing Time [s]", region_growing_seconds);
+	add_view("Nr Planes", nr_planes);
+	add_view("Iteration Progress", detection_iteration_progress);
+	add_view("Assigned Points", detection_point_progress);
+	connect_copy(add_button("Benchmark Scoring")->click, cgv::signal::rebind(this, &plane_tool::benchmark_plane_scoring));
+	connect_copy(add_button("Benchmark Sampling")->click, cgv::signal::rebind(this, &plane_tool::benchmark_plane_sampling));
 	connect_copy(add_button("Reset Planes")->click, cgv::signal::rebind(this, &plane_tool::reset_planes));
 	add_member_control(this, "Default Point Color", default_point_color);
-	if (begin_tree_node("Point Octree", point_octree_ptr)) {
+	if (begin_tree_node("Point Octree", current_node)) {
 		align("\a");
 		add_member_control(this, "Max Nr Points Per Leaf", max_nr_points_per_leaf, "value_slider", "min=1;max=10000;log=true;ticks=true");
+		add_member_control(this, "Nr Threads (0=all)", nr_threads, "value_slider", "min=0;max=64;ticks=true");
 		add_member_control(this, "Ensure Isotropic", ensure_isotropic, "toggle");
+		add_member_control(this, "Morton Octree", use_morton_octree, "toggle");
 		add_view("Node Index", node_index);
+		add_view("Nr Nodes", octree_nr_nodes);
+		add_view("Bytes Per Node", octree_bytes_per_node);
+		add_view("Bytes Per Point", octree_bytes_per_point);
+		add_view("Memory [MB]", octree_memory_mb);
 		connect_copy(add_button("Build Octree")->click, cgv::signal::rebind(this, &plane_tool::build_octree));
+		connect_copy(add_button("Benchmark Morton Kernels")->click, cgv::signal::rebind(this, &plane_tool::benchmark_morton_kernels));
 		connect_copy(add_button("Navigate To Root")->click, cgv::signal::rebind(this, &plane_tool::to_root));
 		connect_copy(add_button("C0")->click, cgv::signal::rebind(this, &plane_tool::to_child, cgv::signal::_c<unsigned>(0)));
 		connect_copy(add_button("C1")->click, cgv::signal::rebind(this, &plane_tool::to_child, cgv::signal::_c<unsigned>(1)));
@@ -283,7 +663,7 @@ void plane_tool::create_gui()
 		connect_copy(add_button("C6")->click, cgv::signal::rebind(this, &plane_tool::to_child, cgv::signal::_c<unsigned>(6)));
 		connect_copy(add_button("C7")->click, cgv::signal::rebind(this, &plane_tool::to_child, cgv::signal::_c<unsigned>(7)));
 		align("\b");
-		end_tree_node(point_octree_ptr);
+		end_tree_node(current_node);
 	}
 	if (begin_tree_node("Sphere Style", srs)) {
 		align("\a");
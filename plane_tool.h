@@ -1,22 +1,35 @@
 #pragma once
 
 #include <cgv/media/color_scale.h>
+#include <cgv/gui/trigger.h>
 #include <cgv_gl/arrow_renderer.h>
 #include <cgv_gl/sphere_renderer.h>
 #include "point_cloud_tool.h"
 #include "octrees.h"
+#include "plane_detection.h"
+#include "region_growing.h"
 
 #include "lib_begin.h"
 
 class CGV_API plane_tool : public point_cloud_tool
 {
 protected:
-	octree_base* point_octree_ptr = 0;
-	octree_base::node_handle node_iter = 0;
+	octree_base::node_ref current_node = { 0, cgv::box3(), 0 };
 	octree_base::node_index_type node_index = 0;
 	unsigned max_nr_points_per_leaf = 50;
+	unsigned nr_threads = 0;
 	bool ensure_isotropic = true;
+	bool use_morton_octree = true;
+	/// memory report of the octree shared with viewer
+	octree_base::node_index_type octree_nr_nodes = 0;
+	float octree_bytes_per_node = 0;
+	float octree_bytes_per_point = 0;
+	float octree_memory_mb = 0;
+	void update_memory_report();
 	void build_octree();
+	/// return octree shared with viewer after ensuring that current node refers to it
+	octree_base* get_navigated_octree();
+	void benchmark_morton_kernels();
 	void to_root();
 	void to_child(unsigned ci);
 	std::vector<cgv::vec3> plane_centers;
@@ -32,12 +45,59 @@ protected:
 	float inlier_percentage = 0.1f;
 	bool early_termination = true;
 	float probability_threshold = 0.01f;
+	/// hypotheses are scored over a structure of arrays copy of the remaining points with vector kernels and in parallel, which finds the same planes as sequential scoring
+	bool vectorize_scoring = true;
+	unsigned scoring_nr_threads = 0;
+	/// number of hypotheses scored together in one pass over the points, where 1 scores each hypothesis separately
+	unsigned hypothesis_batch_size = 64;
+	/// number of least squares refinements of an accepted plane, each of which fits the plane to the inliers of the previous one
+	unsigned nr_refinement_iterations = 3;
+	/// draw the second and third sample point from the octree cell of the first one at a random level
+	bool localized_sampling = false;
+	/// score hypotheses on a random subset of the remaining points first and confirm promising ones on all remaining points
+	bool subset_scoring = false;
+	unsigned scoring_subset_size = 16384;
+	/// region growing over the neighbor graph seeds regions at points of low surface variation and grows them across edges between points of similar normals
+	float region_max_curvature = 0.02f;
+	float region_max_angle = 10.0f;
+	/// durations of the last ransac detection and region growing
+	float ransac_seconds = 0;
+	float region_growing_seconds = 0;
+	/// planes are detected in a background thread that publishes accepted planes, which the trigger takes over to the gui thread
+	plane_detection_job detection_job;
+	cgv::gui::trigger detection_trigger;
+	unsigned nr_planes = 0;
+	float detection_iteration_progress = 0;
+	float detection_point_progress = 0;
 	cgv::render::sphere_render_style srs;
 	cgv::render::arrow_render_style ars;
+	/// return detection settings from the gui members with inliers closer than eps
+	plane_detection_settings get_detection_settings(float eps) const;
+	/// detect planes with ransac among the given points and permute I such that the inliers of plane pli are I[end_idx[pli-1], end_idx[pli]); static such that only the given settings are read from the detection thread;
+	/// localized sampling uses the given octree if it indexes all points; if a job is given, accepted planes are published to it and detection stops when it is cancelled
+	static void detect_planes(const plane_detection_settings& settings, const cgv::vec3* points, unsigned nr_points, const octree_base* sampling_octree_ptr, std::vector<unsigned>& I, std::vector<unsigned>& end_idx, std::vector<cgv::vec3>& centers, std::vector<cgv::vec3>& normals, plane_detection_job* job);
+	/// build octree for localized sampling if the shared one does not index all points
+	void ensure_sampling_octree();
+	/// start plane detection in the background on a copy of the point positions
 	void compute_planes();
+	/// segment planes by region growing over the neighbor graph instead of ransac
+	void grow_regions();
+	cgv::rgba get_plane_color(size_t pli) const;
+	/// append planes published by the detection thread and colorize their inliers
+	void publish_planes();
+	void update_detection_progress();
+	void poll_plane_detection(double t, double dt);
+	/// stop the detection thread and keep the planes it accepted
+	void cancel_plane_detection();
+	/// stop the detection thread and drop planes that were not published yet
+	void discard_plane_detection();
+	/// compare time and result of sequential scalar scoring with the selected scoring per hypothesis and in batches
+	void benchmark_plane_scoring();
+	/// compare time and found planes of uniform and localized sampling each with full and subset scoring
+	void benchmark_plane_sampling();
 	void ensure_colors();
 	void init_colors();
-	void colorize_node(octree_base::node_handle nh, const cgv::rgb& color);
+	void colorize_node(const octree_base::node_ref& nr, const cgv::rgb& color);
 	void colorize_by_node();
 	void reset_planes();
 public:
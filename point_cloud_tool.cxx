@@ -24,6 +24,41 @@ normal_estimator& point_cloud_tool::ref_ne() const
 	return viewer_ptr->ref_normal_estimator();
 }
 
+octree_base* point_cloud_tool::get_octree() const
+{
+	return viewer_ptr->get_octree();
+}
+
+octree_base* point_cloud_tool::ensure_octree()
+{
+	viewer_ptr->ensure_octree_ds();
+	return viewer_ptr->get_octree();
+}
+
+octree_base* point_cloud_tool::ensure_octree_index()
+{
+	if (viewer_ptr->spatial_index != point_cloud_viewer::SI_OCTREE)
+		return 0;
+	return ensure_octree();
+}
+
+octree_base* point_cloud_tool::build_octree(unsigned max_nr_points_per_leaf, bool use_morton_codes, unsigned nr_threads, bool ensure_isotropic)
+{
+	return viewer_ptr->build_octree(max_nr_points_per_leaf, use_morton_codes, nr_threads, ensure_isotropic);
+}
+
+void point_cloud_tool::ensure_neighbor_graph()
+{
+	if (viewer_ptr->ng.size() != viewer_ptr->pc.get_nr_points())
+		viewer_ptr->build_neighbor_graph();
+}
+
+void point_cloud_tool::ensure_normals()
+{
+	if (!viewer_ptr->pc.has_normals())
+		viewer_ptr->compute_normals();
+}
+
 std::string point_cloud_tool::get_icon_file_name() const
 {
 	return std::string();
@@ -41,9 +76,9 @@ std::vector<point_cloud_tool::RGBA>& point_cloud_tool::ref_point_selection_color
 }
 
 
-std::vector<cgv::type::uint8_type>& point_cloud_tool::ref_point_selection() const
+packed_selection& point_cloud_tool::ref_point_selection() const
 {
-	return viewer_ptr->point_selection;
+	return viewer_ptr->point_selection_store;
 }
 
 std::vector<cgv::type::uint8_type>& point_cloud_tool::ref_component_selection() const
@@ -19,10 +19,22 @@ protected:
 	point_cloud& ref_pc() const;
 	neighbor_graph& ref_ng() const;
 	normal_estimator& ref_ne() const;
+	/// return the octree shared with the viewer or 0 if none has been built
+	octree_base* get_octree() const;
+	/// return the octree shared with the viewer after building it with the viewer settings if none exists
+	octree_base* ensure_octree();
+	/// return the octree shared with the viewer after ensuring it if the octree is the spatial index selected in the viewer and 0 otherwise, such that queries never build a second index
+	octree_base* ensure_octree_index();
+	/// replace the shared octree by one built with the given parameters
+	octree_base* build_octree(unsigned max_nr_points_per_leaf, bool use_morton_codes, unsigned nr_threads, bool ensure_isotropic);
+	/// build neighbor graph with the viewer settings if it does not cover all points
+	void ensure_neighbor_graph();
+	/// compute normals with the viewer settings if the point cloud has none
+	void ensure_normals();
 	cgv::render::view* ref_view_ptr() const;
 	bool get_picked_point(int x, int y, unsigned& index) { return viewer_ptr ? viewer_ptr->get_picked_point(x,y,index) : false; }
 	std::vector<RGBA>& ref_point_selection_colors() const;
-	std::vector<cgv::type::uint8_type>& ref_point_selection() const;
+	packed_selection& ref_point_selection() const;
 	std::vector<cgv::type::uint8_type>& ref_component_selection() const;
 	template <typename T>
 	T& ref_variable(const std::string& variable_name, const T& initial_value) {
@@ -1,5 +1,8 @@
 #include "point_cloud_viewer.h"
+#include "brute_force_search.h"
+#include "knn_graph.h"
 #include <algorithm>
+#include <chrono>
 #include <libs/point_cloud/ann_tree.h>
 #include <cgv/base/find_action.h>
 #include <cgv/signal/rebind.h>
@@ -127,8 +130,33 @@ point_cloud_viewer::point_cloud_viewer() : ne(pc, ng)
 	target_max_extent = 1.0f;
 
 	accelerate_picking = true;
+	pick_by_ray_casting = false;
+	pick_pixel_tolerance = 3.0f;
 	tree_ds_out_of_date = true;
 	tree_ds = 0;
+	tree_ds_build_finished = false;
+	tree_ds_build_stale = false;
+	tree_ds_build_requested = false;
+	built_tree_ds = 0;
+	built_tree_ds_points = 0;
+	tree_ds_points = 0;
+	spatial_index = SI_ANN_TREE;
+	octree_ds = 0;
+	octree_max_nr_points_per_leaf = 32;
+	octree_nr_threads = 0;
+	use_morton_octree = true;
+	ooc_max_nr_points_per_leaf = 4096;
+	ooc_build_memory_mb = 1024;
+	ooc_cache_budget_mb = 256;
+	ooc_point_budget = 2000000;
+	ooc_build_finished = false;
+	use_lod = false;
+	lod_max_screen_error = 2.0f;
+	lod_point_budget = 2000000;
+	lod_nr_samples_per_node = 64;
+	lod_nr_points = 0;
+	lod_status = "off";
+	lod_out_of_date = true;
 
 	set_name("point_cloud_viewer");
 	do_append = false;
@@ -148,6 +176,7 @@ point_cloud_viewer::point_cloud_viewer() : ne(pc, ng)
 	show_neighbor_graph = false;
 	k = 30;
 	do_symmetrize = false;
+	parallel_neighbor_graph = true;
 	reorient_normals = true;
 
 	use_component_transformations = false;
@@ -230,6 +259,9 @@ void point_cloud_viewer::draw_graph(cgv::render::context& ctx)
 
 void point_cloud_viewer::interact_callback(double t, double dt)
 {
+	// reap finished background builds of the ann tree and serve pending build requests
+	poll_tree_ds_build();
+	poll_out_of_core_octree_build();
 
 	if (interact_state == IS_FULL_FRAME || interact_state == IS_DRAW_FULL_FRAME)
 		return;
@@ -250,7 +282,7 @@ void point_cloud_viewer::on_register()
 
 bool point_cloud_viewer::init(cgv::render::context& ctx)
 {
-	if (!gl_point_cloud_drawable::init(ctx))
+	if (!gl_point_cloud_drawable::init(ctx) || !lod_drawable.init(ctx))
 		return false;
 
 	
@@ -278,29 +310,419 @@ void point_cloud_viewer::init_frame(cgv::render::context& ctx)
 	gl_point_cloud_drawable::init_frame(ctx);
 }
 
+void point_cloud_viewer::clear(cgv::render::context& ctx)
+{
+	lod_drawable.clear(ctx);
+	gl_point_cloud_drawable::clear(ctx);
+}
+
 void point_cloud_viewer::clear()
 {
 	ng.clear();
 }
+point_cloud_viewer::~point_cloud_viewer()
+{
+	invalidate_tree_ds();
+	tree_ds_build_requested = false;
+	poll_tree_ds_build(true);
+	poll_out_of_core_octree_build(true);
+	if (tree_ds)
+		delete tree_ds;
+	delete tree_ds_points;
+	delete_octree();
+}
+
 void point_cloud_viewer::ensure_tree_ds()
 {
+	// only a running build over the current points is worth waiting for
+	poll_tree_ds_build(!tree_ds_build_stale);
 	if (tree_ds_out_of_date) {
 		if (tree_ds)
 			delete tree_ds;
 		tree_ds = new ann_tree;
 		tree_ds->build(pc);
+		delete tree_ds_points;
+		tree_ds_points = 0;
 		tree_ds_out_of_date = false;
+		tree_ds_build_requested = false;
+	}
+}
+
+void point_cloud_viewer::invalidate_tree_ds()
+{
+	tree_ds_out_of_date = true;
+	tree_ds_build_stale = true;
+}
+
+void point_cloud_viewer::start_tree_ds_build()
+{
+	size_t n = pc.get_nr_points();
+	if (n == 0)
+		return;
+	// the build reads a copy of the positions such that the point cloud can change while the tree is built
+	built_tree_ds_points = new point_cloud;
+	built_tree_ds_points->resize(n);
+	std::copy(&pc.pnt(0), &pc.pnt(0) + n, &built_tree_ds_points->pnt(0));
+	built_tree_ds = new ann_tree;
+	tree_ds_build_stale = false;
+	tree_ds_build_finished = false;
+	tree_ds_thread = std::thread([this]() {
+		built_tree_ds->build(*built_tree_ds_points);
+		tree_ds_build_finished = true;
+	});
+}
+
+void point_cloud_viewer::request_tree_ds_build()
+{
+	if (tree_ds_thread.joinable())
+		tree_ds_build_requested = true;
+	else
+		start_tree_ds_build();
+}
+
+bool point_cloud_viewer::poll_tree_ds_build(bool wait)
+{
+	if (!tree_ds_thread.joinable())
+		return !tree_ds_out_of_date;
+	if (!wait && !tree_ds_build_finished)
+		return false;
+	tree_ds_thread.join();
+	if (tree_ds_build_stale) {
+		delete built_tree_ds;
+		delete built_tree_ds_points;
+	}
+	else {
+		// swap in finished tree on the gui thread, such that users of tree_ds never see a partially built tree
+		if (tree_ds)
+			delete tree_ds;
+		delete tree_ds_points;
+		tree_ds = built_tree_ds;
+		tree_ds_points = built_tree_ds_points;
+		tree_ds_out_of_date = false;
+	}
+	built_tree_ds = 0;
+	built_tree_ds_points = 0;
+	if (tree_ds_build_requested) {
+		tree_ds_build_requested = false;
+		if (tree_ds_out_of_date && spatial_index == SI_ANN_TREE)
+			start_tree_ds_build();
+	}
+	return !tree_ds_out_of_date;
+}
+
+void point_cloud_viewer::ensure_octree_ds()
+{
+	if (!octree_ds)
+		build_octree(octree_max_nr_points_per_leaf, use_morton_octree, octree_nr_threads);
+}
+
+octree_base* point_cloud_viewer::build_octree(unsigned max_nr_points_per_leaf, bool use_morton_codes, unsigned nr_threads, bool ensure_isotropic)
+{
+	delete_octree();
+	lod_out_of_date = true;
+	if (use_morton_codes)
+		octree_ds = new point_octree;
+	else
+		octree_ds = new simple_point_octree;
+	octree_ds->nr_threads = nr_threads;
+	octree_ds->construct(pc.get_nr_points() > 0 ? &pc.pnt(0) : 0, octree_base::point_index_type(pc.get_nr_points()), max_nr_points_per_leaf, ensure_isotropic);
+	return octree_ds;
+}
+
+void point_cloud_viewer::delete_octree()
+{
+	if (octree_ds) {
+		delete octree_ds;
+		octree_ds = 0;
+	}
+	lod.clear();
+	lod_out_of_date = true;
+}
+
+void point_cloud_viewer::insert_appended_points_into_octree()
+{
+	octree_ds->insert_points(pc.get_nr_points() > 0 ? &pc.pnt(0) : 0, octree_base::point_index_type(pc.get_nr_points()));
+	lod.clear();
+	lod_out_of_date = true;
+}
+
+void point_cloud_viewer::benchmark_spatial_indices()
+{
+	Idx n = Idx(pc.get_nr_points());
+	if (n == 0)
+		return;
+	typedef std::chrono::steady_clock clock;
+	auto seconds_since = [](clock::time_point start) { return std::chrono::duration<double>(clock::now() - start).count(); };
+	// query at a strided subset of the points
+	Idx nr_queries = std::min(n, Idx(100000)), stride = n / nr_queries;
+	std::vector<float> ann_kth_sqr_dists(nr_queries);
+
+	double ann_build_time, ann_knn_time, ann_closest_time;
+	auto start = clock::now();
+	{
+		ann_tree T;
+		T.build(pc);
+		ann_build_time = seconds_since(start);
+		std::vector<Idx> N;
+		start = clock::now();
+		for (Idx qi = 0; qi < nr_queries; ++qi) {
+			T.extract_neighbors(qi * stride, k, N);
+			float kth_sqr_dist = 0;
+			for (Idx j : N)
+				kth_sqr_dist = std::max(kth_sqr_dist, (pc.pnt(j) - pc.pnt(qi * stride)).sqr_length());
+			ann_kth_sqr_dists[qi] = kth_sqr_dist;
+		}
+		ann_knn_time = seconds_since(start);
+		start = clock::now();
+		for (Idx qi = 0; qi < nr_queries; ++qi)
+			T.find_closest(pc.pnt(qi * stride));
+		ann_closest_time = seconds_since(start);
 	}
+	// the ann tree is released before the octree is built to not keep both in memory
+	octree_base* O = use_morton_octree ? (octree_base*)new point_octree : new simple_point_octree;
+	O->nr_threads = octree_nr_threads;
+	start = clock::now();
+	O->construct(&pc.pnt(0), octree_base::point_index_type(n), octree_max_nr_points_per_leaf, true);
+	double octree_build_time = seconds_since(start);
+	std::vector<octree_base::distance_index_pair> knn;
+	Idx nr_mismatches = 0;
+	start = clock::now();
+	for (Idx qi = 0; qi < nr_queries; ++qi) {
+		O->find_k_nearest(pc.pnt(qi * stride), k, knn, qi * stride);
+		if ((knn.empty() ? 0.0f : knn.back().first) != ann_kth_sqr_dists[qi])
+			++nr_mismatches;
+	}
+	double octree_knn_time = seconds_since(start);
+	start = clock::now();
+	for (Idx qi = 0; qi < nr_queries; ++qi)
+		O->find_closest(pc.pnt(qi * stride));
+	double octree_closest_time = seconds_since(start);
+	delete O;
+
+	std::cout << "spatial index benchmark with " << n << " points, " << nr_queries << " queries and k = " << k << "\n"
+		<< "  ann tree: build " << ann_build_time << " sec, knn " << 1e6 * ann_knn_time / nr_queries << " us/query, closest " << 1e6 * ann_closest_time / nr_queries << " us/query\n"
+		<< "  octree:   build " << octree_build_time << " sec, knn " << 1e6 * octree_knn_time / nr_queries << " us/query, closest " << 1e6 * octree_closest_time / nr_queries << " us/query\n"
+		<< "  queries with differing k-th neighbor distance: " << nr_mismatches << std::endl;
+}
+
+void point_cloud_viewer::reorder_by_morton_codes()
+{
+	Idx n = Idx(pc.get_nr_points());
+	if (n == 0)
+		return;
+	auto start = std::chrono::steady_clock::now();
+	// compute codes over the bounding box and sort them per component
+	cgv::box3 domain = pc.box();
+	std::vector<uint_fast64_t> codes(n);
+	std::vector<octree_base::point_index_type> order(n);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		point_octree::compute_morton_codes(domain, &pc.pnt(Idx(b)), e - b, reinterpret_cast<uint64_t*>(codes.data() + b));
+		std::iota(order.begin() + b, order.begin() + e, octree_base::point_index_type(b));
+	}, octree_nr_threads);
+	if (pc.has_components()) {
+		for (Idx ci = 0; ci < Idx(pc.get_nr_components()); ++ci) {
+			const auto& range = pc.component_point_range(ci);
+			point_octree::sort_morton_codes(codes.data() + range.index_of_first_point, order.data() + range.index_of_first_point, range.nr_points, octree_nr_threads);
+		}
+	}
+	else
+		point_octree::sort_morton_codes(codes.data(), order.data(), n, octree_nr_threads);
+	// perm maps old to new point indices
+	std::vector<Idx> perm(n);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			perm[order[i]] = Idx(i);
+	}, octree_nr_threads);
+	pc.permute(perm, true);
+	if (point_selection_store.size() == size_t(n))
+		point_selection_store.permute(perm, octree_nr_threads);
+	std::cout << "reordered " << n << " points by morton codes in "
+		<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " sec" << std::endl;
+	on_point_order_change(perm);
+}
+
+void point_cloud_viewer::on_point_order_change(const std::vector<Idx>& perm)
+{
+	Idx n = Idx(pc.get_nr_points());
+	if (ng.size() == size_t(n) && perm.size() == size_t(n)) {
+		std::vector<std::vector<Idx> > neighbors(n);
+		parallel_for(0, n, [&](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				std::vector<Idx>& N = neighbors[perm[i]];
+				N.swap(ng[i]);
+				for (Idx& j : N)
+					j = perm[j];
+			}
+		}, octree_nr_threads);
+		for (Idx i = 0; i < n; ++i)
+			ng[i].swap(neighbors[i]);
+	}
+	else
+		ng.clear();
+	// the ann tree refers to the old order and the octree is dropped by the change callback
+	invalidate_tree_ds();
+	int pcc_event = PCC_POINTS;
+	if (pc.has_normals())
+		pcc_event |= PCC_NORMALS;
+	if (pc.has_colors())
+		pcc_event |= PCC_COLORS;
+	if (pc.has_texture_coordinates())
+		pcc_event |= PCC_TEXCOORDS;
+	if (pc.has_pixel_coordinates())
+		pcc_event |= PCC_PIXCOORDS;
+	if (!ng.empty())
+		pcc_event |= PCC_NEIGHBORGRAPH;
+	on_point_cloud_change_callback(PointCloudChangeEvent(pcc_event));
+}
+
+void point_cloud_viewer::benchmark_morton_reorder()
+{
+	if (pc.get_nr_points() == 0)
+		return;
+	typedef std::chrono::steady_clock clock;
+	auto seconds_since = [](clock::time_point start) { return std::chrono::duration<double>(clock::now() - start).count(); };
+	double neighbor_graph_times[2], normal_times[2];
+	for (unsigned pass = 0; pass < 2; ++pass) {
+		if (pass == 1)
+			reorder_by_morton_codes();
+		// rebuild spatial indices in both passes to compare equal work
+		delete_octree();
+		invalidate_tree_ds();
+		ng.clear();
+		auto start = clock::now();
+		build_neighbor_graph();
+		neighbor_graph_times[pass] = seconds_since(start);
+		start = clock::now();
+		ne.compute_weighted_normals(false);
+		normal_times[pass] = seconds_since(start);
+	}
+	on_point_cloud_change_callback(PCC_NORMALS);
+	std::cout << "morton reorder benchmark with " << pc.get_nr_points() << " points and k = " << k << "\n"
+		<< "  neighbor graph: " << neighbor_graph_times[0] << " sec in file order, " << neighbor_graph_times[1] << " sec in morton order\n"
+		<< "  normals:        " << normal_times[0] << " sec in file order, " << normal_times[1] << " sec in morton order" << std::endl;
+}
+
+void point_cloud_viewer::build_out_of_core_octree()
+{
+	if (ooc_file_name.empty() || ooc_build_thread.joinable())
+		return;
+	out_of_core_octree_builder builder;
+	builder.max_nr_points_per_leaf = ooc_max_nr_points_per_leaf;
+	builder.memory_budget = size_t(ooc_build_memory_mb) << 20;
+	// the file is opened exclusively during construction
+	ooc_octree.close();
+	// the build reads a copy of the positions such that the point cloud can change while the octree is built
+	ooc_build_points.clear();
+	if (ooc_source_file_name.empty() && pc.get_nr_points() > 0)
+		ooc_build_points.assign(&pc.pnt(0), &pc.pnt(0) + pc.get_nr_points());
+	ooc_build_log.str("");
+	ooc_build_finished = false;
+	ooc_build_thread = std::thread([this, builder, source_file_name = ooc_source_file_name, file_name = ooc_file_name]() mutable {
+		if (source_file_name.empty()) {
+			memory_point_chunk_source source(ooc_build_points.empty() ? 0 : &ooc_build_points[0], ooc_build_points.size());
+			builder.build(source, file_name, ooc_build_log);
+		}
+		else {
+			xyz_file_point_chunk_source source(source_file_name);
+			builder.build(source, file_name, ooc_build_log);
+		}
+		ooc_build_finished = true;
+	});
+}
+
+void point_cloud_viewer::poll_out_of_core_octree_build(bool wait)
+{
+	if (!ooc_build_thread.joinable() || (!wait && !ooc_build_finished))
+		return;
+	ooc_build_thread.join();
+	std::cout << ooc_build_log.str() << std::flush;
+	ooc_build_points.clear();
+	ooc_build_points.shrink_to_fit();
+}
+
+void point_cloud_viewer::open_out_of_core_octree()
+{
+	poll_out_of_core_octree_build(true);
+	if (!ooc_octree.open(ooc_file_name)) {
+		std::cerr << "could not open out-of-core octree " << ooc_file_name << std::endl;
+		return;
+	}
+	ooc_octree.set_cache_budget(size_t(ooc_cache_budget_mb) << 20);
+	std::cout << "opened out-of-core octree with " << ooc_octree.get_nr_points() << " points and " << ooc_octree.nodes.size() << " nodes" << std::endl;
+	load_out_of_core_points(false);
+}
+
+void point_cloud_viewer::load_out_of_core_points(bool only_view_region)
+{
+	if (!ooc_octree.is_open())
+		return;
+	box3 region = ooc_octree.domain;
+	if (only_view_region && ensure_view_pointer()) {
+		Pnt focus = view_ptr->get_focus();
+		Crd extent = Crd(view_ptr->get_y_extent_at_focus());
+		region = box3(focus - Pnt(extent, extent, extent), focus + Pnt(extent, extent, extent));
+	}
+	ooc_octree.set_cache_budget(size_t(ooc_cache_budget_mb) << 20);
+	ooc_octree.reset_cache_statistics();
+	auto start = std::chrono::steady_clock::now();
+	std::vector<cgv::vec3> points;
+	ooc_octree.extract_points(region, ooc_point_budget, points);
+	pc.clear();
+	pc.resize(points.size());
+	for (size_t i = 0; i < points.size(); ++i)
+		pc.pnt(i) = points[i];
+	ooc_stats = ooc_octree.get_cache_statistics();
+	std::cout << "loaded " << points.size() << " of " << ooc_octree.get_nr_points() << " points in "
+		<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " sec with "
+		<< ooc_stats.nr_faults << " page faults, " << ooc_stats.nr_hits << " hits, " << ooc_stats.nr_evictions << " evictions, "
+		<< ooc_stats.nr_resident_pages << " resident pages and " << (ooc_stats.peak_resident_bytes >> 20) << " MB peak residency" << std::endl;
+	update_member(&ooc_stats.nr_faults);
+	update_member(&ooc_stats.nr_hits);
+	update_member(&ooc_stats.nr_evictions);
+	update_member(&ooc_stats.nr_resident_pages);
+	update_member(&ooc_stats.resident_bytes);
+	update_member(&ooc_stats.peak_resident_bytes);
+	on_point_cloud_change_callback(PCC_NEW_POINT_CLOUD);
 }
 
 void point_cloud_viewer::build_neighbor_graph()
 {
 	clear();
-	ensure_tree_ds();
 	cgv::utils::statistics he_stats;
-	ng.build(pc.get_nr_points(), k, *tree_ds, &he_stats);
+	auto start = std::chrono::steady_clock::now();
+	// only the selected spatial index is queried, such that no second index is built
+	bool use_octree = spatial_index == SI_OCTREE;
+	if (use_octree) {
+		ensure_octree_ds();
+		if (parallel_neighbor_graph) {
+			ng.clear();
+			ng.nr_half_edges = build_knn_graph(*octree_ds, k, ng, octree_nr_threads);
+			for (const auto& N : ng)
+				he_stats.update(double(N.size()));
+		}
+		else {
+			Idx n = Idx(pc.get_nr_points());
+			ng.nr_half_edges = 0;
+			ng.resize(n);
+			std::vector<octree_base::distance_index_pair> knn;
+			for (Idx i = 0; i < n; ++i) {
+				octree_ds->find_k_nearest(pc.pnt(i), k, knn, octree_base::point_index_type(i));
+				ng[i].resize(knn.size());
+				for (size_t j = 0; j < knn.size(); ++j)
+					ng[i][j] = Idx(knn[j].second);
+				ng.nr_half_edges += knn.size();
+				he_stats.update(double(knn.size()));
+			}
+		}
+	}
+	else {
+		ensure_tree_ds();
+		ng.build(pc.get_nr_points(), k, *tree_ds, &he_stats);
+	}
 	if (do_symmetrize)
-		ng.symmetrize();
+		ng.nr_half_edges += symmetrize_graph(ng, octree_nr_threads);
+	std::cout << "built neighbor graph with " << (use_octree ? "octree" : "ann tree") << (use_octree && parallel_neighbor_graph ? " in parallel" : "") << " in "
+		<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " sec" << std::endl;
 	on_point_cloud_change_callback(PCC_NEIGHBORGRAPH_CREATE);
 
 	std::cout << "half edge statistics " << he_stats << std::endl;
@@ -351,9 +773,69 @@ void point_cloud_viewer::orient_normals()
 	post_redraw();
 }
 
+bool point_cloud_viewer::get_pick_ray(int x, int y, Pnt& origin, Pnt& dir, float& pixel_size_at_origin, float& pixel_size_slope) const
+{
+	if (!view_ptr || !get_context())
+		return false;
+	float w = float(get_context()->get_width()), h = float(get_context()->get_height());
+	if (w <= 0 || h <= 0)
+		return false;
+	Pnt view_dir = Pnt(view_ptr->get_view_dir());
+	view_dir.normalize();
+	Pnt up = Pnt(view_ptr->get_view_up_dir());
+	up = up - dot(up, view_dir) * view_dir;
+	up.normalize();
+	Pnt right = cross(view_dir, up);
+	// offsets of pixel center from the view center in units of half the view height
+	float u = (2.0f * (float(x) + 0.5f) / w - 1.0f) * w / h, v = 1.0f - 2.0f * (float(y) + 0.5f) / h;
+	double y_view_angle = view_ptr->get_y_view_angle();
+	if (y_view_angle > 0) {
+		float tan_half_angle = float(tan(0.5 * y_view_angle * 0.017453292519943295));
+		origin = Pnt(view_ptr->get_eye());
+		dir = view_dir + u * tan_half_angle * right + v * tan_half_angle * up;
+		dir.normalize();
+		// pixels grow with the depth along the view direction
+		pixel_size_at_origin = 0;
+		pixel_size_slope = 2.0f * tan_half_angle / h * dot(dir, view_dir);
+	}
+	else {
+		// orthographic rays start behind the scene
+		float half_extent = 0.5f * float(view_ptr->get_y_extent_at_focus());
+		Pnt focus = Pnt(view_ptr->get_focus());
+		float back = pc.box().get_extent().length() + (pc.box().get_center() - focus).length();
+		origin = focus + u * half_extent * right + v * half_extent * up - back * view_dir;
+		dir = view_dir;
+		pixel_size_at_origin = 2.0f * half_extent / h;
+		pixel_size_slope = 0;
+	}
+	return true;
+}
+
 /// return the point under the mouse pointer in world coordinates
 bool point_cloud_viewer::get_picked_point(int x, int y, unsigned& index)
 {
+	if (pc.get_nr_points() == 0)
+		return false;
+	if (pick_by_ray_casting && spatial_index == SI_OCTREE) {
+		// surfels are sized in world units and the tolerance is given in pixels
+		Pnt origin, dir;
+		float pixel_size_at_origin, pixel_size_slope;
+		if (!get_pick_ray(x, y, origin, dir, pixel_size_at_origin, pixel_size_slope))
+			return false;
+		float radius = 0.5f * surfel_style.point_size + pick_pixel_tolerance * pixel_size_at_origin, slope = pick_pixel_tolerance * pixel_size_slope;
+		size_t i_first;
+		if (accelerate_picking) {
+			ensure_octree_ds();
+			octree_base::point_index_type i = octree_ds->find_first_in_cone(origin, dir, radius, slope);
+			i_first = i == octree_base::point_index_type(-1) ? size_t(-1) : size_t(i);
+		}
+		else
+			i_first = find_first_in_cone_brute_force(&pc.pnt(0), pc.get_nr_points(), origin, dir, radius, slope);
+		if (i_first == size_t(-1))
+			return false;
+		index = unsigned(i_first);
+		return true;
+	}
 	cgv::math::fvec<double, 3> world_location;
 	if (!get_world_location(x, y, *view_ptr, world_location))
 		return false;
@@ -363,26 +845,24 @@ bool point_cloud_viewer::get_picked_point(int x, int y, unsigned& index)
 	// find closest point
 	int i_closest = -1;
 	if (accelerate_picking) {
-		ensure_tree_ds();
-		i_closest = tree_ds->find_closest(p_pick_world);
-	}
-	else {
-		int n = (int)pc.get_nr_points();
-		float smallest_sqr_dist = 0;
-		for (int i = 0; i < n; ++i) {
-			if (i_closest == -1) {
-				i_closest = i;
-				smallest_sqr_dist = (pc.pnt(i) - p_pick_world).sqr_length();
-			}
+		if (spatial_index == SI_OCTREE) {
+			ensure_octree_ds();
+			octree_base::point_index_type i = octree_ds->find_closest(p_pick_world);
+			if (i != octree_base::point_index_type(-1))
+				i_closest = int(i);
+		}
+		else {
+			// picks are answered by a brute force scan while the ann tree is built in the background
+			if (poll_tree_ds_build())
+				i_closest = tree_ds->find_closest(p_pick_world);
 			else {
-				float new_sqr_dist = (pc.pnt(i) - p_pick_world).sqr_length();
-				if (new_sqr_dist < smallest_sqr_dist) {
-					i_closest = i;
-					smallest_sqr_dist = new_sqr_dist;
-				}
+				request_tree_ds_build();
+				i_closest = int(find_closest_point_brute_force(&pc.pnt(0), pc.get_nr_points(), p_pick_world));
 			}
 		}
 	}
+	else
+		i_closest = int(find_closest_point_brute_force(&pc.pnt(0), pc.get_nr_points(), p_pick_world));
 	if (i_closest == -1)
 		return false;
 	index = i_closest;
@@ -440,19 +920,98 @@ void point_cloud_viewer::draw(cgv::render::context& ctx)
 	if (selected_tool != -1)
 		tools[selected_tool]->draw(ctx);
 
-	if (interact_state != IS_DRAW_FULL_FRAME)
+	// level of detail replaces striding during interaction, but group transformations and colors require the component order of points
+	bool draw_lod = use_lod && !pc.has_components();
+	const char* status = draw_lod ? "active" : (use_lod ? "inactive with components" : "off");
+	if (lod_status != status) {
+		lod_status = status;
+		update_member(&lod_status);
+	}
+	if (interact_state != IS_DRAW_FULL_FRAME && !draw_lod)
 		std::swap(show_point_step, interact_point_step);
 
-	gl_point_cloud_drawable::draw(ctx);
+	if (!draw_lod && color_mode_overwrite == CMO_POINT_SELECTION)
+		point_selection_store.materialize(point_selection, octree_nr_threads);
+	if (draw_lod)
+		draw_level_of_detail(ctx);
+	else
+		gl_point_cloud_drawable::draw(ctx);
 
 	if (interact_state != IS_DRAW_FULL_FRAME) {
-		std::swap(show_point_step, interact_point_step);
+		if (!draw_lod)
+			std::swap(show_point_step, interact_point_step);
 		interact_state = IS_INTERMEDIATE_FRAME;
 	}
 	else
 		interact_state = IS_FULL_FRAME;
 }
 
+void point_cloud_viewer::draw_level_of_detail(cgv::render::context& ctx)
+{
+	ensure_octree_ds();
+	if (lod_out_of_date) {
+		lod.build(*octree_ds, lod_nr_samples_per_node, octree_nr_threads);
+		lod_out_of_date = false;
+	}
+	lod_view view;
+	view.set(ctx.get_projection_matrix(), ctx.get_modelview_matrix(), float(ctx.get_height()));
+	size_t n = lod.select_cut(view, lod_max_screen_error, lod_point_budget, lod_cut);
+	if (lod_nr_points != unsigned(n)) {
+		lod_nr_points = unsigned(n);
+		update_member(&lod_nr_points);
+	}
+
+	// gather samples of cut into the point cloud of the level of detail drawable
+	point_cloud& lod_pc = lod_drawable.pc;
+	if (lod_pc.has_normals() != pc.has_normals() || lod_pc.has_colors() != pc.has_colors())
+		lod_pc = point_cloud();
+	lod_pc.resize(n);
+	if (pc.has_normals() && !lod_pc.has_normals())
+		lod_pc.create_normals();
+	if (pc.has_colors() && !lod_pc.has_colors())
+		lod_pc.create_colors();
+	bool gather_selection = color_mode_overwrite == CMO_POINT_SELECTION && point_selection_store.size() == pc.get_nr_points();
+	lod_point_selection.resize(gather_selection ? n : 0);
+	size_t i = 0;
+	for (auto ni : lod_cut) {
+		const octree_base::point_index_type* samples = lod.get_samples(ni);
+		for (octree_base::point_index_type j = 0; j < lod.get_nr_samples(ni); ++j, ++i) {
+			Idx pi = Idx(samples[j]);
+			lod_pc.pnt(i) = pc.pnt(pi);
+			if (pc.has_normals())
+				lod_pc.nml(i) = pc.nml(pi);
+			if (pc.has_colors())
+				lod_pc.clr(i) = pc.clr(pi);
+			if (gather_selection)
+				lod_point_selection[i] = point_selection_store.get(pi);
+		}
+	}
+
+	// level of detail is only drawn without components, such that component colors, transformations and boxes do not apply
+	lod_drawable.view_ptr = view_ptr;
+	lod_drawable.surfel_style = surfel_style;
+	lod_drawable.surfel_style.use_group_color = false;
+	lod_drawable.surfel_style.use_group_transformation = false;
+	lod_drawable.normal_style = normal_style;
+	lod_drawable.box_style = box_style;
+	lod_drawable.box_wire_style = box_wire_style;
+	lod_drawable.show_points = show_points;
+	lod_drawable.show_nmls = show_nmls;
+	lod_drawable.show_box = show_box;
+	lod_drawable.show_boxes = false;
+	lod_drawable.sort_points = sort_points;
+	lod_drawable.use_component_colors = false;
+	lod_drawable.use_component_transformations = false;
+	lod_drawable.use_these_point_colors = 0;
+	lod_drawable.use_these_component_colors = 0;
+	lod_drawable.use_these_point_color_indices = gather_selection ? &lod_point_selection : 0;
+	lod_drawable.use_these_point_palette = gather_selection ? use_these_point_palette : 0;
+	lod_drawable.show_point_begin = 0;
+	lod_drawable.show_point_end = lod_pc.get_nr_points();
+	lod_drawable.show_point_step = 1;
+	lod_drawable.draw(ctx);
+}
+
 bool point_cloud_viewer::save(const std::string& fn)
 {
 	if (!write(fn)) {
@@ -517,17 +1076,28 @@ void point_cloud_viewer::on_point_cloud_change_callback(PointCloudChangeEvent pc
 			surfel_style.illumination_mode = cgv::render::IM_OFF;
 		update_member(&surfel_style.illumination_mode);
 	}
+	// octree depends on point positions, appended points are inserted incrementally and otherwise the octree is rebuilt lazily
+	if ((pcc_event & PCC_POINTS_APPEND) != 0 && octree_ds && octree_ds->get_nr_indexed_points() <= pc.get_nr_points())
+		insert_appended_points_into_octree();
+	else if ((pcc_event & PCC_POINTS_MASK) != 0)
+		delete_octree();
+	// the static ann kd-tree cannot be extended and is rebuilt in the background
 	if (((pcc_event & PCC_POINTS_MASK) == PCC_POINTS_RESIZE) || ((pcc_event & PCC_POINTS_MASK) == PCC_NEW_POINT_CLOUD)) {
-		tree_ds_out_of_date = true;
+		invalidate_tree_ds();
 		if (tree_ds) {
 			delete tree_ds;
 			tree_ds = 0;
 		}
+		delete tree_ds_points;
+		tree_ds_points = 0;
+		// build the ann tree early in the background instead of on the first pick, where changes during a running build are coalesced into one build after it
+		if (spatial_index == SI_ANN_TREE)
+			request_tree_ds_build();
 		ng.clear();
 		show_point_end = pc.get_nr_points();
 		show_point_begin = 0;
 
-		point_selection.resize(pc.get_nr_points());
+		point_selection_store.resize(pc.get_nr_points());
 
 		update_member(&show_point_begin);
 		update_member(&show_point_end);
@@ -591,7 +1161,7 @@ bool point_cloud_viewer::open_and_append(const std::string& _file_name)
 		cgv::gui::message(last_error);
 		return false;
 	}
-	on_point_cloud_change_callback(PointCloudChangeEvent(PCC_POINTS_RESIZE + PCC_COMPONENTS_RESIZE));
+	on_point_cloud_change_callback(PointCloudChangeEvent(PCC_POINTS_RESIZE + PCC_POINTS_APPEND + PCC_COMPONENTS_RESIZE));
 	return true;
 }
 
@@ -623,6 +1193,7 @@ bool point_cloud_viewer::self_reflect(cgv::reflect::reflection_handler& srh)
 		srh.reflect_member("show_neighbor_graph", show_neighbor_graph) &&
 		srh.reflect_member("k", k) &&
 		srh.reflect_member("do_symmetrize", do_symmetrize) &&
+		srh.reflect_member("parallel_neighbor_graph", parallel_neighbor_graph) &&
 		srh.reflect_member("reorient_normals", reorient_normals) &&
 		srh.reflect_member("master_path", master_path))
 		return true;
@@ -729,6 +1300,24 @@ void point_cloud_viewer::on_set(void* member_ptr)
 	if (member_ptr == &ne.localization_scale || member_ptr == &ne.normal_sigma || member_ptr == &ne.bw_type || member_ptr == &ne.plane_distance_scale) {
 		on_point_cloud_change_callback(PCC_WEIGHTS);
 	}
+	if (member_ptr == &lod_nr_samples_per_node)
+		lod_out_of_date = true;
+	if (member_ptr == &use_lod || member_ptr == &lod_max_screen_error || member_ptr == &lod_point_budget || member_ptr == &lod_nr_samples_per_node)
+		post_redraw();
+	if (member_ptr == &spatial_index) {
+		if (spatial_index == SI_OCTREE) {
+			if (tree_ds) {
+				delete tree_ds;
+				tree_ds = 0;
+			}
+			delete tree_ds_points;
+			tree_ds_points = 0;
+			invalidate_tree_ds();
+		}
+		else
+			delete_octree();
+		post_recreate_gui();
+	}
 	if (member_ptr == &selected_tool) {
 		on_tool_change_callback(last_tool_index);
 		last_tool_index = selected_tool;
@@ -1162,6 +1751,34 @@ void point_cloud_viewer::create_gui()
 	if (show) {
 		align("\a");
 		add_member_control(this, "accelerate_picking", accelerate_picking, "check");
+		add_member_control(this, "spatial_index", spatial_index, "dropdown", "enums='ann tree,octree'");
+		// the ann tree cannot answer cone queries, such that rays would be tested against all points
+		if (spatial_index == SI_OCTREE) {
+			add_member_control(this, "pick_by_ray_casting", pick_by_ray_casting, "check");
+			add_member_control(this, "pick_pixel_tolerance", pick_pixel_tolerance, "value_slider", "min=0;max=20;ticks=true");
+		}
+		if (begin_tree_node("level of detail", use_lod, false, "level=3")) {
+			align("\a");
+			add_member_control(this, "use_lod", use_lod, "check");
+			add_member_control(this, "max_screen_error", lod_max_screen_error, "value_slider", "min=0.1;max=100;log=true;ticks=true");
+			add_member_control(this, "point_budget", lod_point_budget, "value_slider", "min=10000;max=100000000;log=true;ticks=true");
+			add_member_control(this, "samples_per_node", lod_nr_samples_per_node, "value_slider", "min=1;max=4096;log=true;ticks=true");
+			add_view("status", lod_status);
+			add_view("nr_points", lod_nr_points);
+			align("\b");
+			end_tree_node(use_lod);
+		}
+		if (begin_tree_node("octree", octree_max_nr_points_per_leaf, false, "level=3")) {
+			align("\a");
+			add_member_control(this, "max_nr_points_per_leaf", octree_max_nr_points_per_leaf, "value_slider", "min=1;max=1000;log=true;ticks=true");
+			add_member_control(this, "nr_threads (0=all)", octree_nr_threads, "value_slider", "min=0;max=64;ticks=true");
+			add_member_control(this, "morton_octree", use_morton_octree, "toggle");
+			connect_copy(add_button("benchmark spatial indices")->click, cgv::signal::rebind(this, &point_cloud_viewer::benchmark_spatial_indices));
+			connect_copy(add_button("reorder by morton code")->click, cgv::signal::rebind(this, &point_cloud_viewer::reorder_by_morton_codes));
+			connect_copy(add_button("benchmark morton reorder")->click, cgv::signal::rebind(this, &point_cloud_viewer::benchmark_morton_reorder));
+			align("\b");
+			end_tree_node(octree_max_nr_points_per_leaf);
+		}
 		if (begin_tree_node("subsample", show_point_step, false, "level=3")) {
 			align("\a");
 			add_member_control(this, "nr_draw_calls", nr_draw_calls, "value_slider", "min=1;max=100;log=true;ticks=true");
@@ -1183,6 +1800,27 @@ void point_cloud_viewer::create_gui()
 		align("\b");
 		end_tree_node(show_points);
 	}
+	if (begin_tree_node("out of core", ooc_octree, false, "level=3")) {
+		align("\a");
+		add_gui("source", ooc_source_file_name, "file_name", "w=150;open=true;title='open xyz file (empty to use current points)';filter='xyz (xyz):*.xyz|all files:*.*'");
+		add_gui("octree", ooc_file_name, "file_name", "w=150;open=true;save=true;title='out-of-core octree file';filter='out-of-core octree (oco):*.oco|all files:*.*'");
+		add_member_control(this, "max_nr_points_per_leaf", ooc_max_nr_points_per_leaf, "value_slider", "min=16;max=65536;log=true;ticks=true");
+		add_member_control(this, "build_memory_mb", ooc_build_memory_mb, "value_slider", "min=16;max=16384;log=true;ticks=true");
+		add_member_control(this, "cache_budget_mb", ooc_cache_budget_mb, "value_slider", "min=1;max=16384;log=true;ticks=true");
+		add_member_control(this, "point_budget", ooc_point_budget, "value_slider", "min=1000;max=100000000;log=true;ticks=true");
+		connect_copy(add_button("build")->click, cgv::signal::rebind(this, &point_cloud_viewer::build_out_of_core_octree));
+		connect_copy(add_button("open")->click, cgv::signal::rebind(this, &point_cloud_viewer::open_out_of_core_octree));
+		connect_copy(add_button("load all")->click, cgv::signal::rebind(this, &point_cloud_viewer::load_out_of_core_points, cgv::signal::_c<bool>(false)));
+		connect_copy(add_button("load view region")->click, cgv::signal::rebind(this, &point_cloud_viewer::load_out_of_core_points, cgv::signal::_c<bool>(true)));
+		add_view("page faults", ooc_stats.nr_faults);
+		add_view("page hits", ooc_stats.nr_hits);
+		add_view("evictions", ooc_stats.nr_evictions);
+		add_view("resident pages", ooc_stats.nr_resident_pages);
+		add_view("resident bytes", ooc_stats.resident_bytes);
+		add_view("peak resident bytes", ooc_stats.peak_resident_bytes);
+		align("\b");
+		end_tree_node(ooc_octree);
+	}
 	show = begin_tree_node("components", pc.components, false, "level=3;w=100;align=' '");
 	add_member_control(this, "show", surfel_style.use_group_color, "toggle", "w=50");
 	if (show) {
@@ -1217,6 +1855,8 @@ void point_cloud_viewer::create_gui()
 	if (show) {
 		add_member_control(this, "k", k, "value_slider", "min=3;max=50;log=true;ticks=true");
 		add_member_control(this, "symmetrize", do_symmetrize, "toggle");
+		if (spatial_index == SI_OCTREE)
+			add_member_control(this, "parallel", parallel_neighbor_graph, "toggle");
 		cgv::signal::connect_copy(add_button("build")->click, cgv::signal::rebind(this, &point_cloud_viewer::build_neighbor_graph));
 		end_tree_node(show_neighbor_graph);
 	}
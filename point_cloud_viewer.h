@@ -12,6 +12,13 @@
 #include <libs/point_cloud/gl_point_cloud_drawable.h>
 #include <libs/point_cloud/neighbor_graph.h>
 #include <libs/point_cloud/normal_estimator.h>
+#include "octrees.h"
+#include "out_of_core_octree.h"
+#include "lod_octree.h"
+#include "selection_store.h"
+#include <atomic>
+#include <sstream>
+#include <thread>
 
 #include "lib_begin.h"
 
@@ -62,10 +69,18 @@ enum PointCloudChangeEvent
 	PCC_NEIGHBORGRAPH_MASK = 0x3000,
 
 	PCC_WEIGHTS                = 0x4000,
-	PCC_COMPONENT_TRANSFORMATION_CHANGE = 0x8000
+	PCC_COMPONENT_TRANSFORMATION_CHANGE = 0x8000,
+	/// set together with PCC_POINTS_RESIZE if points have only been appended behind the existing points
+	PCC_POINTS_APPEND          = 0x10000
 };
 
 
+/// drawable of the level of detail samples with its own point cloud, whose render settings are copied from the viewer before drawing such that the viewer's point cloud is never replaced
+class lod_point_cloud_drawable : public gl_point_cloud_drawable
+{
+	friend class point_cloud_viewer;
+};
+
 class CGV_API point_cloud_viewer :
 	public cgv::base::group,
 	public cgv::gui::event_handler,
@@ -110,15 +125,98 @@ protected:
 	neighbor_graph ng;
 	normal_estimator ne;
 
+	/// spatial index used for picking and neighbor graph construction, only the selected one is kept in memory;
+	/// an ann tree built in the background refers to its own copy of the point positions, which doubles the memory of the positions as long as the tree lives
+	enum SpatialIndex {
+		SI_ANN_TREE,
+		SI_OCTREE
+	} spatial_index;
+	/// octree over the point positions that is shared with the tools
+	octree_base* octree_ds;
+	unsigned octree_max_nr_points_per_leaf;
+	unsigned octree_nr_threads;
+	bool use_morton_octree;
+
+	/// out-of-core octree from which budget limited previews of the positions are loaded into the point cloud, on which picking and all tools operate
+	out_of_core_octree ooc_octree;
+	out_of_core_octree::cache_statistics ooc_stats;
+	std::string ooc_source_file_name;
+	std::string ooc_file_name;
+	unsigned ooc_max_nr_points_per_leaf;
+	unsigned ooc_build_memory_mb;
+	unsigned ooc_cache_budget_mb;
+	unsigned ooc_point_budget;
+	/// out-of-core octree built in a background thread from a copy of the point positions or from the source file, whose log is printed once the build is reaped
+	std::thread ooc_build_thread;
+	std::atomic<bool> ooc_build_finished;
+	std::vector<cgv::vec3> ooc_build_points;
+	std::ostringstream ooc_build_log;
+	/// start to build the out-of-core octree in a background thread unless a build is running
+	void build_out_of_core_octree();
+	/// reap a finished background build of the out-of-core octree, where wait blocks until a running build finishes
+	void poll_out_of_core_octree_build(bool wait = false);
+	void open_out_of_core_octree();
+	void load_out_of_core_points(bool only_view_region);
+
 	bool accelerate_picking;
+	/// pick the front most point within a cone around the view ray through the mouse position instead of the point closest to the depth buffer location; only offered with the octree as spatial index, as the ann tree cannot answer cone queries
+	bool pick_by_ray_casting;
+	/// radius in pixels of the picking cone in addition to the surfel radius
+	float pick_pixel_tolerance;
 	bool tree_ds_out_of_date;
+	/// ann tree built in a background thread over a copy of the point positions, which replaces tree_ds once finished unless the points changed in the meantime
+	std::thread tree_ds_thread;
+	std::atomic<bool> tree_ds_build_finished;
+	bool tree_ds_build_stale;
+	/// whether a build over the current points is to be started once the running build finishes, such that at most one build runs and bursts of point changes are coalesced
+	bool tree_ds_build_requested;
+	ann_tree* built_tree_ds;
+	point_cloud* built_tree_ds_points;
+	/// copy of the point positions over which tree_ds has been built in the background, which is kept alive as long as the tree
+	point_cloud* tree_ds_points;
 	bool show_neighbor_graph;
 	unsigned k;
 	bool do_symmetrize;
+	/// whether to build the neighbor graph with parallel octree queries in morton order if the octree is the spatial index; ann tree queries share global search state and always run sequentially
+	bool parallel_neighbor_graph;
 
 	bool reorient_normals;
 
 	void ensure_tree_ds();
+	/// mark tree_ds as out of date and discard the result of a running background build
+	void invalidate_tree_ds();
+	/// start to build tree_ds in a background thread, which must only be called if no build is running
+	void start_tree_ds_build();
+	/// start a background build of tree_ds now or, if a build is running, once it finishes without waiting for it
+	void request_tree_ds_build();
+	/// swap in the tree of a finished background build or discard it if stale and serve a pending build request, where wait blocks until a running build finishes, and return whether tree_ds is up to date
+	bool poll_tree_ds_build(bool wait = false);
+	void ensure_octree_ds();
+	/// replace octree by one built with the given parameters and return it
+	octree_base* build_octree(unsigned max_nr_points_per_leaf, bool use_morton_codes, unsigned nr_threads, bool ensure_isotropic = true);
+	void delete_octree();
+	/// insert points appended to the point cloud into the existing octree
+	void insert_appended_points_into_octree();
+	void benchmark_spatial_indices();
+	/// reorder points along the morton curve over the bounding box, where each component is sorted within its point range, and remap point selection and neighbor graph
+	void reorder_by_morton_codes();
+	/// time construction of neighbor graph and normals before and after reordering by morton codes
+	void benchmark_morton_reorder();
+
+	/// level of detail rendering of a cut through the octree selected by projected error and point budget
+	bool use_lod;
+	float lod_max_screen_error;
+	unsigned lod_point_budget;
+	unsigned lod_nr_samples_per_node;
+	unsigned lod_nr_points;
+	/// state of level of detail rendering shown in the gui, which is inactive for point clouds with components
+	std::string lod_status;
+	bool lod_out_of_date;
+	point_lod_octree lod;
+	std::vector<octree_base::node_index_type> lod_cut;
+	lod_point_cloud_drawable lod_drawable;
+	std::vector<cgv::type::uint8_type> lod_point_selection;
+	void draw_level_of_detail(cgv::render::context& ctx);
 	void build_neighbor_graph();
 	void clear();
 	void draw_edge_color(unsigned int vi, unsigned int j, bool is_symm, bool is_start) const;
@@ -131,6 +229,8 @@ protected:
 	void orient_normals();
 	void orient_normals_to_view_point();
 
+	/// compute the view ray through pixel (x,y) of the current view, along which a pixel spans pixel_size_at_origin + pixel_size_slope * t in world units at ray parameter t
+	bool get_pick_ray(int x, int y, Pnt& origin, Pnt& dir, float& pixel_size_at_origin, float& pixel_size_slope) const;
 	bool get_picked_point(int x, int y, unsigned& index);
 
 	void interact_callback(double t, double dt);
@@ -147,6 +247,8 @@ protected:
 
 	
 	// selection
+	packed_selection point_selection_store;
+	/// one byte per point view of point_selection_store used as color indices, which is materialized before drawing
 	std::vector<cgv::type::uint8_type> point_selection;
 	std::vector<cgv::type::uint8_type> component_selection;
 	std::vector<RGBA> point_selection_colors;
@@ -159,11 +261,15 @@ protected:
 	int last_modifier_press;
 	point_cloud& ref_point_cloud() { return pc; }
 	neighbor_graph& ref_neighbor_graph() { return ng; }
+	/// remap the neighbor graph, drop the spatial indices and notify tools after all point attributes have been permuted by moving point i to perm[i]
+	void on_point_order_change(const std::vector<Idx>& perm);
+	octree_base* get_octree() const { return octree_ds; }
 	normal_estimator& ref_normal_estimator() { return ne; }
 	bool am_i_active(point_cloud_tool_ptr tool_ptr) const { return selected_tool == -1 ? false : (tools[selected_tool] == tool_ptr); }
 	friend class point_cloud_tool;
 public:
 	point_cloud_viewer();
+	~point_cloud_viewer();
 	void on_register();
 	void on_point_cloud_change_callback(PointCloudChangeEvent pcc_event);
 	void on_selection_change_callback(SelectType type);
@@ -172,6 +278,7 @@ public:
 	bool self_reflect(cgv::reflect::reflection_handler& srh);
 	void stream_stats(std::ostream&);
 	bool init(cgv::render::context& ctx);
+	void clear(cgv::render::context& ctx);
 	void init_frame(cgv::render::context& ctx);
 	void draw(cgv::render::context& ctx);
 	void finish_draw(cgv::render::context& ctx);
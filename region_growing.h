@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "plane_detection.h"
+
+/// union find over n elements that supports concurrent unite and find calls without locks: roots are only ever linked below a smaller root with a compare and swap,
+/// such that the root of a set is its smallest element, and find halves paths with compare and swaps that can only shortcut to an ancestor
+struct concurrent_union_find
+{
+	std::vector<std::atomic<uint32_t>> parent;
+	void init(size_t n, unsigned nr_threads = 0)
+	{
+		std::vector<std::atomic<uint32_t>>(n).swap(parent);
+		parallel_for(0, n, [&](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i)
+				parent[i].store(uint32_t(i), std::memory_order_relaxed);
+		}, nr_threads);
+	}
+	uint32_t find(uint32_t i)
+	{
+		for (;;) {
+			uint32_t p = parent[i].load();
+			if (p == i)
+				return i;
+			uint32_t gp = parent[p].load();
+			if (gp != p)
+				parent[i].compare_exchange_weak(p, gp);
+			i = gp;
+		}
+	}
+	void unite(uint32_t a, uint32_t b)
+	{
+		for (;;) {
+			a = find(a);
+			b = find(b);
+			if (a == b)
+				return;
+			if (a < b)
+				std::swap(a, b);
+			// link larger root a below b, which fails if a stopped being a root in the meantime
+			uint32_t expected = a;
+			if (parent[a].compare_exchange_strong(expected, b))
+				return;
+		}
+	}
+};
+
+static const uint32_t invalid_region_label = uint32_t(-1);
+
+/// return the surface variation of the neighborhood of point i, which is the smallest eigenvalue of its covariance divided by the sum of all eigenvalues
+template <typename neighbor_range_type>
+float compute_surface_variation(const cgv::vec3* points, uint32_t i, const neighbor_range_type& neighbors)
+{
+	plane_fit_moments m;
+	m.add(0, 0, 0);
+	for (auto j : neighbors) {
+		cgv::vec3 d = points[j] - points[i];
+		m.add(d[0], d[1], d[2]);
+	}
+	if (m.n < 3)
+		return 1.0f;
+	double C[6], c[3];
+	m.compute_covariance(C, c);
+	double trace = C[0] + C[3] + C[5];
+	if (trace <= 0)
+		return 0.0f;
+	return float(std::max(0.0, compute_smallest_eigenvalue(C)) / trace);
+}
+
+/// segment points into planar regions by region growing over the edges of a neighbor graph ng with ng[i] listing the neighbors of point i, which is done in parallel with a concurrent union find:
+/// points of surface variation below max_curvature are seeds that are united with neighboring seeds whose normal deviates by less than the angle of cosine min_cos_angle and which lie closer than max_distance to the tangent planes of each other;
+/// afterwards each other point joins the region of the best aligned compatible seed neighbor without merging regions; labels[i] is set to the smallest seed index of the region of point i or invalid_region_label
+template <typename graph_type>
+void grow_plane_regions(const cgv::vec3* points, const cgv::vec3* normals, const graph_type& ng, size_t n,
+	float max_curvature, float min_cos_angle, float max_distance, std::vector<uint32_t>& labels, unsigned nr_threads = 0)
+{
+	auto are_compatible = [&](uint32_t i, uint32_t j) {
+		if (std::abs(dot(normals[i], normals[j])) < min_cos_angle)
+			return false;
+		cgv::vec3 d = points[j] - points[i];
+		return std::abs(dot(d, normals[i])) < max_distance && std::abs(dot(d, normals[j])) < max_distance;
+	};
+	std::vector<uint8_t> is_seed(n);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			is_seed[i] = compute_surface_variation(points, uint32_t(i), ng[i]) < max_curvature ? 1 : 0;
+	}, nr_threads, 1024);
+	concurrent_union_find regions;
+	regions.init(n, nr_threads);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i) {
+			if (!is_seed[i])
+				continue;
+			for (auto j : ng[i])
+				if (uint32_t(j) != i && is_seed[j] && are_compatible(uint32_t(i), uint32_t(j)))
+					regions.unite(uint32_t(i), uint32_t(j));
+		}
+	}, nr_threads, 1024);
+	labels.resize(n);
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			labels[i] = is_seed[i] ? regions.find(uint32_t(i)) : invalid_region_label;
+	}, nr_threads);
+	// labels of seeds are final now, so other points can read them while their own labels are written
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i) {
+			if (is_seed[i])
+				continue;
+			float best_cos_angle = min_cos_angle;
+			for (auto j : ng[i]) {
+				if (!is_seed[j] || !are_compatible(uint32_t(i), uint32_t(j)))
+					continue;
+				float cos_angle = std::abs(dot(normals[i], normals[j]));
+				if (cos_angle >= best_cos_angle) {
+					best_cos_angle = cos_angle;
+					labels[i] = labels[j];
+				}
+			}
+		}
+	}, nr_threads, 1024);
+}
+
+/// collect the regions with at least min_nr_points points in order of decreasing size and keep at most max_nr_regions of them; as for ransac detection I is a permutation of all points,
+/// where region ri owns I[end_idx[ri-1], end_idx[ri]) in increasing point order and unassigned points follow; centers and normals of the regions come from least squares fits oriented like the point normals
+inline void extract_plane_regions(const cgv::vec3* points, const cgv::vec3* normals, const std::vector<uint32_t>& labels, size_t min_nr_points, size_t max_nr_regions,
+	std::vector<uint32_t>& I, std::vector<uint32_t>& end_idx, std::vector<cgv::vec3>& centers, std::vector<cgv::vec3>& region_normals, unsigned nr_threads = 0)
+{
+	size_t n = labels.size();
+	std::vector<uint32_t> region_index(n, 0);
+	for (uint32_t l : labels)
+		if (l != invalid_region_label)
+			++region_index[l];
+	std::vector<uint32_t> regions;
+	for (uint32_t l = 0; l < n; ++l)
+		if (region_index[l] >= std::max(min_nr_points, size_t(1)))
+			regions.push_back(l);
+	std::stable_sort(regions.begin(), regions.end(), [&](uint32_t l0, uint32_t l1) { return region_index[l0] > region_index[l1]; });
+	if (regions.size() > max_nr_regions)
+		regions.resize(max_nr_regions);
+	// offsets of regions in I with a last slot for unassigned points
+	std::vector<uint32_t> offsets(regions.size() + 2, 0);
+	for (size_t ri = 0; ri < regions.size(); ++ri)
+		offsets[ri + 1] = offsets[ri] + region_index[regions[ri]];
+	end_idx.assign(offsets.begin() + 1, offsets.begin() + 1 + regions.size());
+	std::fill(region_index.begin(), region_index.end(), uint32_t(regions.size()));
+	for (size_t ri = 0; ri < regions.size(); ++ri)
+		region_index[regions[ri]] = uint32_t(ri);
+	I.resize(n);
+	for (uint32_t i = 0; i < n; ++i) {
+		uint32_t ri = labels[i] == invalid_region_label ? uint32_t(regions.size()) : region_index[labels[i]];
+		I[offsets[ri]++] = i;
+	}
+	centers.resize(regions.size());
+	region_normals.resize(regions.size());
+	parallel_tasks(regions.size(), [&](size_t ri) {
+		uint32_t begin = ri == 0 ? 0 : end_idx[ri - 1], end = end_idx[ri];
+		const cgv::vec3& reference = points[I[begin]];
+		plane_fit_moments m;
+		for (uint32_t k = begin; k < end; ++k) {
+			cgv::vec3 d = points[I[k]] - reference;
+			m.add(d[0], d[1], d[2]);
+		}
+		plane_hypothesis h = { reference, normals[I[begin]] };
+		m.fit(reference, h);
+		centers[ri] = h.p0;
+		region_normals[ri] = h.nml;
+	}, nr_threads);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "lod_octree.h"
+#include "parallel.h"
+
+/// inside mask of a polygon in window coordinates with y pointing down, which is rasterized at pixel centers with the even odd rule and extended by a summed area table to count inside pixels of rectangles
+struct polygon_mask
+{
+	/// pixel rectangle covered by the mask, which is the bounding rectangle of the polygon clipped to the viewport
+	int x0 = 0, y0 = 0, width = 0, height = 0;
+	std::vector<uint8_t> mask;
+	/// entry (x,y) counts the inside pixels in the rectangle [0,x) x [0,y) of the mask, rows have width+1 entries
+	std::vector<uint32_t> area_table;
+	void rasterize(const std::vector<cgv::vec2>& polygon, int viewport_width, int viewport_height, unsigned nr_threads = 0)
+	{
+		width = height = 0;
+		mask.clear();
+		area_table.clear();
+		if (polygon.size() < 3)
+			return;
+		float min_x = polygon[0][0], max_x = min_x, min_y = polygon[0][1], max_y = min_y;
+		for (const auto& p : polygon) {
+			min_x = std::min(min_x, p[0]); max_x = std::max(max_x, p[0]);
+			min_y = std::min(min_y, p[1]); max_y = std::max(max_y, p[1]);
+		}
+		x0 = std::max(0, int(std::floor(min_x)));
+		y0 = std::max(0, int(std::floor(min_y)));
+		int x1 = std::min(viewport_width, int(std::floor(max_x)) + 1), y1 = std::min(viewport_height, int(std::floor(max_y)) + 1);
+		if (x1 <= x0 || y1 <= y0)
+			return;
+		width = x1 - x0;
+		height = y1 - y0;
+		mask.assign(size_t(width) * height, 0);
+		// each row collects the crossings of the polygon edges with its center line and fills pixel centers between pairs of crossings
+		parallel_for(0, size_t(height), [&](size_t b, size_t e) {
+			std::vector<float> crossings;
+			for (size_t r = b; r < e; ++r) {
+				float y = float(y0 + int(r)) + 0.5f;
+				crossings.clear();
+				for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+					const cgv::vec2& p = polygon[i], & q = polygon[j];
+					if ((p[1] <= y) != (q[1] <= y))
+						crossings.push_back(p[0] + (y - p[1]) * (q[0] - p[0]) / (q[1] - p[1]));
+				}
+				std::sort(crossings.begin(), crossings.end());
+				uint8_t* row = &mask[r * width];
+				for (size_t k = 0; k + 1 < crossings.size(); k += 2) {
+					int begin = std::max(0, int(std::ceil(crossings[k] - 0.5f)) - x0);
+					int end = std::min(width, int(std::ceil(crossings[k + 1] - 0.5f)) - x0);
+					for (int c = begin; c < end; ++c)
+						row[c] = 1;
+				}
+			}
+		}, nr_threads, 16);
+		area_table.assign(size_t(width + 1) * (height + 1), 0);
+		for (int r = 0; r < height; ++r) {
+			uint32_t row_sum = 0;
+			for (int c = 0; c < width; ++c) {
+				row_sum += mask[size_t(r) * width + c];
+				area_table[size_t(r + 1) * (width + 1) + c + 1] = area_table[size_t(r) * (width + 1) + c + 1] + row_sum;
+			}
+		}
+	}
+	bool empty() const { return width == 0; }
+	/// return whether the pixel containing window position (x,y) is inside of the polygon
+	bool is_inside(float x, float y) const
+	{
+		float fx = std::floor(x) - x0, fy = std::floor(y) - y0;
+		if (!(fx >= 0 && fy >= 0 && fx < width && fy < height))
+			return false;
+		return mask[size_t(fy) * width + size_t(fx)] != 0;
+	}
+	/// return number of inside pixels and number of all pixels of the pixel rectangle [xmin,xmax] x [ymin,ymax], where pixels outside of the mask count as outside
+	void count_pixels(int xmin, int ymin, int xmax, int ymax, size_t& nr_inside, size_t& nr_pixels) const
+	{
+		nr_pixels = size_t(xmax - xmin + 1) * size_t(ymax - ymin + 1);
+		int c0 = std::max(xmin - x0, 0), r0 = std::max(ymin - y0, 0), c1 = std::min(xmax - x0 + 1, width), r1 = std::min(ymax - y0 + 1, height);
+		if (c1 <= c0 || r1 <= r0) {
+			nr_inside = 0;
+			return;
+		}
+		size_t w = size_t(width + 1);
+		nr_inside = area_table[r1 * w + c1] - area_table[r0 * w + c1] - area_table[r1 * w + c0] + area_table[r0 * w + c0];
+	}
+};
+
+/// projection of points to window coordinates with y pointing down
+struct screen_projection
+{
+	lod_view view;
+	float width = 0, height = 0;
+	template <typename matrix_type>
+	void set(const matrix_type& projection, const matrix_type& modelview, float viewport_width, float viewport_height)
+	{
+		view.set(projection, modelview, viewport_height);
+		width = viewport_width;
+		height = viewport_height;
+	}
+	/// compute window coordinates of p and return false if p does not lie in front of the eye
+	bool project(const cgv::vec3& p, float& x, float& y) const
+	{
+		float c[4];
+		for (unsigned i = 0; i < 4; ++i)
+			c[i] = view.mvp[i][0] * p[0] + view.mvp[i][1] * p[1] + view.mvp[i][2] * p[2] + view.mvp[i][3];
+		if (c[3] <= 1e-6f)
+			return false;
+		x = (0.5f * c[0] / c[3] + 0.5f) * width;
+		y = (0.5f - 0.5f * c[1] / c[3]) * height;
+		return true;
+	}
+	/// return whether p lies in front of the eye and projects to an inside pixel of mask
+	bool is_selected(const cgv::vec3& p, const polygon_mask& mask) const
+	{
+		float x, y;
+		return project(p, x, y) && mask.is_inside(x, y);
+	}
+};
+
+/// set inside[i] to 1 for the n points point(i) that are selected by mask and to 0 otherwise, where points are projected in parallel
+template <typename point_accessor_type>
+void select_points_in_polygon(size_t n, point_accessor_type point, const screen_projection& projection, const polygon_mask& mask, uint8_t* inside, unsigned nr_threads = 0)
+{
+	parallel_for(0, n, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i)
+			inside[i] = projection.is_selected(point(i), mask) ? 1 : 0;
+	}, nr_threads);
+}
+
+/// set inside[i] to 1 for the points indexed by octree that are selected by mask and leave entries of other points untouched; nodes in front of the eye are classified by the pixel rectangle of their projected corners,
+/// where nodes without inside pixels are skipped and nodes with only inside pixels are accepted without projecting their points; the remaining leaves are tested point by point in parallel
+inline void select_points_in_polygon(const octree_base& octree, const screen_projection& projection, const polygon_mask& mask, uint8_t* inside, unsigned nr_threads = 0)
+{
+	typedef octree_base::node_index_type node_index_type;
+	typedef octree_base::point_index_type point_index_type;
+	if (octree.get_nr_nodes() == 0 || mask.empty())
+		return;
+	float margin = octree.get_query_margin();
+	std::vector<node_index_type> accepted_nodes, tested_nodes;
+	octree.visit_depth_first([&](const octree_base::node_ref& nr) {
+		cgv::vec3 lo = nr.box.get_min_pnt() - cgv::vec3(margin), hi = nr.box.get_max_pnt() + cgv::vec3(margin);
+		float min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+		bool in_front = true;
+		for (unsigned ci = 0; ci < 8 && in_front; ++ci) {
+			float x, y;
+			cgv::vec3 corner((ci & 1) ? hi[0] : lo[0], (ci & 2) ? hi[1] : lo[1], (ci & 4) ? hi[2] : lo[2]);
+			in_front = projection.project(corner, x, y);
+			if (ci == 0) {
+				min_x = max_x = x;
+				min_y = max_y = y;
+			}
+			else {
+				min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+				min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+			}
+		}
+		// projection of a node crossing the eye plane is unbounded
+		if (in_front) {
+			size_t nr_inside, nr_pixels;
+			mask.count_pixels(int(std::floor(min_x)), int(std::floor(min_y)), int(std::floor(max_x)), int(std::floor(max_y)), nr_inside, nr_pixels);
+			if (nr_inside == 0)
+				return false;
+			if (nr_inside == nr_pixels) {
+				accepted_nodes.push_back(nr.node_index);
+				return false;
+			}
+		}
+		if (!octree.is_leaf(nr.node_index))
+			return true;
+		tested_nodes.push_back(nr.node_index);
+		return false;
+	});
+	size_t nr_accepted = accepted_nodes.size();
+	parallel_tasks(nr_accepted + tested_nodes.size(), [&](size_t ti) {
+		node_index_type ni = ti < nr_accepted ? accepted_nodes[ti] : tested_nodes[ti - nr_accepted];
+		point_index_type first_point = octree.get_first_point(ni), end_point = first_point + octree.get_nr_points(ni);
+		for (point_index_type pi = first_point; pi < end_point; ++pi) {
+			point_index_type i = octree.point_indices[pi];
+			if (ti < nr_accepted || projection.is_selected(octree.points_ptr[i], mask))
+				inside[i] = 1;
+		}
+	}, nr_threads);
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+#include "parallel.h"
+
+/// selection classes 0-3 of n points packed into two bits per point, such that range updates and counts process the 32 points of a 64 bit word with a few word operations;
+/// a run length summary per block of 4096 points records a class shared by all points of the block, which answers counts and range updates of uniform blocks without touching their words;
+/// renderers that need one byte per point get a view that is only rewritten over the range of points changed since its last materialization
+class packed_selection
+{
+public:
+	static const size_t points_per_word = 32;
+	static const size_t words_per_block = 128;
+	static const size_t points_per_block = points_per_word * words_per_block;
+	/// summary of blocks that may contain points of different classes
+	static const uint8_t mixed_block = 0xFF;
+protected:
+	size_t n = 0;
+	/// bits of points beyond n are kept zero
+	std::vector<uint64_t> words;
+	std::vector<uint8_t> block_classes;
+	size_t dirty_begin = 0, dirty_end = 0;
+	static uint64_t broadcast(uint8_t c) { return 0x5555555555555555ull * c; }
+	/// return mask of the low bits of the two bit fields that have class c
+	static uint64_t match_class(uint64_t w, uint8_t c) { uint64_t x = w ^ broadcast(c); return ~(x | (x >> 1)) & 0x5555555555555555ull; }
+	static size_t count_bits(uint64_t w) { return std::bitset<64>(w).count(); }
+	/// return mask of the fields of word wi that belong to points in [begin,end)
+	static uint64_t range_mask(size_t wi, size_t begin, size_t end)
+	{
+		size_t first = wi * points_per_word;
+		size_t b = begin > first ? begin - first : 0, e = std::min(end - first, size_t(points_per_word));
+		uint64_t mask = e == points_per_word ? ~0ull : (1ull << (2 * e)) - 1;
+		return mask & ~((1ull << (2 * b)) - 1);
+	}
+	size_t get_nr_blocks() const { return (n + points_per_block - 1) / points_per_block; }
+	void mark_dirty(size_t begin, size_t end)
+	{
+		if (begin >= end)
+			return;
+		if (dirty_begin >= dirty_end) {
+			dirty_begin = begin;
+			dirty_end = end;
+		}
+		else {
+			dirty_begin = std::min(dirty_begin, begin);
+			dirty_end = std::max(dirty_end, end);
+		}
+	}
+	/// recompute summary of block bi from its words
+	void update_block_class(size_t bi)
+	{
+		size_t wb = bi * words_per_block, we = std::min(wb + words_per_block, words.size());
+		uint8_t c = uint8_t(words[wb] & 3);
+		uint64_t pattern = broadcast(c);
+		for (size_t wi = wb; wi < we; ++wi)
+			if (((words[wi] ^ pattern) & range_mask(wi, 0, n)) != 0) {
+				block_classes[bi] = mixed_block;
+				return;
+			}
+		block_classes[bi] = c;
+	}
+	/// call f(block_index, begin, end) in parallel for the blocks intersecting [begin,end) with the intersected point ranges
+	template <typename F>
+	void for_each_block(size_t begin, size_t end, F f, unsigned nr_threads) const
+	{
+		if (begin >= end)
+			return;
+		size_t first_block = begin / points_per_block, end_block = (end - 1) / points_per_block + 1;
+		parallel_for(first_block, end_block, [&](size_t bb, size_t be) {
+			for (size_t bi = bb; bi < be; ++bi)
+				f(bi, std::max(begin, bi * points_per_block), std::min(end, (bi + 1) * points_per_block));
+		}, nr_threads, 16);
+	}
+	/// overwrite the fields selected by mask of word wi with class c
+	void write_fields(size_t wi, uint64_t mask, uint8_t c) { words[wi] = (words[wi] & ~mask) | (broadcast(c) & mask); }
+public:
+	size_t size() const { return n; }
+	/// resize to new_n points, where new points get class 0
+	void resize(size_t new_n)
+	{
+		size_t old_n = n;
+		n = new_n;
+		words.resize((n + points_per_word - 1) / points_per_word, 0);
+		if (!words.empty())
+			words.back() &= range_mask(words.size() - 1, 0, n);
+		block_classes.resize(get_nr_blocks(), 0);
+		for (size_t bi = std::min(old_n, n) / points_per_block; bi < block_classes.size(); ++bi)
+			update_block_class(bi);
+		dirty_end = std::min(dirty_end, n);
+		mark_dirty(std::min(old_n, n), n);
+	}
+	uint8_t get(size_t i) const { return uint8_t(words[i / points_per_word] >> (2 * (i % points_per_word))) & 3; }
+	/// set class of point i, which is not thread safe as neighboring points share words
+	void set(size_t i, uint8_t c)
+	{
+		uint64_t& w = words[i / points_per_word];
+		unsigned shift = unsigned(2 * (i % points_per_word));
+		w = (w & ~(3ull << shift)) | (uint64_t(c) << shift);
+		uint8_t& bc = block_classes[i / points_per_block];
+		if (bc != c)
+			bc = mixed_block;
+		mark_dirty(i, i + 1);
+	}
+	/// set class of all points in [begin,end) to c
+	void set_range(size_t begin, size_t end, uint8_t c, unsigned nr_threads = 0)
+	{
+		for_each_block(begin, end, [&](size_t bi, size_t b, size_t e) {
+			uint8_t& bc = block_classes[bi];
+			if (bc == c)
+				return;
+			for (size_t wi = b / points_per_word; wi < (e - 1) / points_per_word + 1; ++wi)
+				write_fields(wi, range_mask(wi, b, e), c);
+			bool covers_block = b == bi * points_per_block && e == std::min(n, (bi + 1) * points_per_block);
+			bc = covers_block ? c : mixed_block;
+		}, nr_threads);
+		mark_dirty(begin, end);
+	}
+	/// replace class from by class to for all points in [begin,end)
+	void replace_in_range(size_t begin, size_t end, uint8_t from, uint8_t to, unsigned nr_threads = 0)
+	{
+		if (from == to)
+			return;
+		for_each_block(begin, end, [&](size_t bi, size_t b, size_t e) {
+			uint8_t& bc = block_classes[bi];
+			if (bc != mixed_block && bc != from)
+				return;
+			for (size_t wi = b / points_per_word; wi < (e - 1) / points_per_word + 1; ++wi) {
+				uint64_t m = match_class(words[wi], from) & range_mask(wi, b, e);
+				write_fields(wi, m | (m << 1), to);
+			}
+			if (bc == from)
+				bc = b == bi * points_per_block && e == std::min(n, (bi + 1) * points_per_block) ? to : mixed_block;
+		}, nr_threads);
+		mark_dirty(begin, end);
+	}
+	/// set class of each point i in [begin,end) to f(i, class of i), where blocks of points are processed in parallel
+	template <typename F>
+	void transform(size_t begin, size_t end, F f, unsigned nr_threads = 0)
+	{
+		for_each_block(begin, end, [&](size_t bi, size_t b, size_t e) {
+			for (size_t wi = b / points_per_word; wi < (e - 1) / points_per_word + 1; ++wi) {
+				size_t first = wi * points_per_word;
+				uint64_t w = words[wi];
+				for (size_t i = std::max(b, first); i < std::min(e, first + points_per_word); ++i) {
+					unsigned shift = unsigned(2 * (i - first));
+					w = (w & ~(3ull << shift)) | (uint64_t(f(i, uint8_t(w >> shift) & 3) & 3) << shift);
+				}
+				words[wi] = w;
+			}
+			update_block_class(bi);
+		}, nr_threads);
+		mark_dirty(begin, end);
+	}
+	/// set counts[c] to the number of points of class c for all four classes
+	void count_classes(size_t counts[4], unsigned nr_threads = 0) const
+	{
+		std::vector<size_t> block_counts(4 * get_nr_blocks(), 0);
+		for_each_block(0, n, [&](size_t bi, size_t b, size_t e) {
+			size_t* cnts = &block_counts[4 * bi];
+			uint8_t bc = block_classes[bi];
+			if (bc != mixed_block) {
+				cnts[bc] = e - b;
+				return;
+			}
+			for (size_t wi = b / points_per_word; wi < (e - 1) / points_per_word + 1; ++wi) {
+				uint64_t mask = range_mask(wi, b, e);
+				for (uint8_t c = 1; c < 4; ++c)
+					cnts[c] += count_bits(match_class(words[wi], c) & mask);
+			}
+			cnts[0] = (e - b) - cnts[1] - cnts[2] - cnts[3];
+		}, nr_threads);
+		std::fill(counts, counts + 4, size_t(0));
+		for (size_t bi = 0; bi < block_classes.size(); ++bi)
+			for (unsigned c = 0; c < 4; ++c)
+				counts[c] += block_counts[4 * bi + c];
+	}
+	/// move the class of each point i to point perm[i]
+	template <typename index_type>
+	void permute(const std::vector<index_type>& perm, unsigned nr_threads = 0)
+	{
+		std::vector<uint64_t> permuted_words(words.size(), 0);
+		for (size_t i = 0; i < n; ++i) {
+			size_t j = size_t(perm[i]);
+			permuted_words[j / points_per_word] |= uint64_t(get(i)) << (2 * (j % points_per_word));
+		}
+		words.swap(permuted_words);
+		parallel_for(0, block_classes.size(), [&](size_t b, size_t e) {
+			for (size_t bi = b; bi < e; ++bi)
+				update_block_class(bi);
+		}, nr_threads, 16);
+		mark_dirty(0, n);
+	}
+	/// return whether the byte per point view is out of date
+	bool is_dirty() const { return dirty_begin < dirty_end; }
+	/// bring byte per point view up to date by unpacking the points changed since the last call
+	void materialize(std::vector<uint8_t>& view, unsigned nr_threads = 0)
+	{
+		if (view.size() != n) {
+			view.resize(n);
+			mark_dirty(0, n);
+		}
+		if (!is_dirty())
+			return;
+		parallel_for(dirty_begin / points_per_word, (dirty_end - 1) / points_per_word + 1, [&](size_t wb, size_t we) {
+			for (size_t wi = wb; wi < we; ++wi) {
+				size_t first = wi * points_per_word, last = std::min(first + points_per_word, n);
+				uint64_t w = words[wi];
+				for (size_t i = first; i < last; ++i, w >>= 2)
+					view[i] = uint8_t(w & 3);
+			}
+		}, nr_threads, 1024);
+		dirty_begin = dirty_end = 0;
+	}
+};
@@ -1,10 +1,13 @@
 #include "selection_tool.h"
+#include "permutation.h"
 #include <cgv/gui/dialog.h>
 #include <cgv/gui/key_event.h>
 #include <cgv/gui/mouse_event.h>
 #include <cgv_gl/gl/gl.h>
 #include <cgv_reflect_types/media/axis_aligned_box.h>
 #include <cgv_reflect_types/media/color.h>
+#include <algorithm>
+#include <chrono>
 
 selection_tool::selection_tool(point_cloud_viewer_ptr pcv_ptr) : point_cloud_tool(pcv_ptr,"select"), box_color(0, 1, 0, 1)
 {
@@ -17,6 +20,17 @@ selection_tool::selection_tool(point_cloud_viewer_ptr pcv_ptr) : point_cloud_too
 	select_index = 0;
 	select_range = index_range(0,1);
 	show_box = true;
+	last_selection_valid = false;
+	view_projection_valid = false;
+	polygon_active = false;
+	brush_stroke_active = false;
+	brush_redraw_pending = false;
+	use_brush = true;
+	brush_in_screen_space = true;
+	brush_radius = 0.01f;
+	brush_pixel_radius = 10.0f;
+	use_spatial_index = true;
+	permute_in_place_enabled = false;
 	show_selection.resize(ref_point_selection_colors().size());
 	for (unsigned i=0; i<ref_point_selection_colors().size(); ++i)
 		(bool&)(show_selection[i]) = ref_point_selection_colors()[i][3] > 0.0f ? true : false;
@@ -31,42 +45,168 @@ void selection_tool::reset_selection_box()
 	}
 }
 
-std::vector<cgv::type::uint8_type>& selection_tool::ref_selection() const
+cgv::type::uint8_type selection_tool::get_new_selection(cgv::type::uint8_type s, bool part_of_selection) const
+{
+	if (part_of_selection)
+		return action == SA_DEL ? 0 : current_selection;
+	if (action == SA_SET && s == current_selection)
+		return 0;
+	return s;
+}
+
+void selection_tool::apply_action(Idx i, bool part_of_selection)
 {
 	if (type == ST_POINT)
-		return ref_point_selection();
+		ref_point_selection().set(i, get_new_selection(ref_point_selection().get(i), part_of_selection));
 	else
-		return ref_component_selection();
+		ref_component_selection()[i] = get_new_selection(ref_component_selection()[i], part_of_selection);
 }
 
-void selection_tool::apply_action(Idx i, bool part_of_selection)
+void selection_tool::apply_action_to_range(Idx begin, Idx end, bool part_of_selection)
 {
-	if (part_of_selection) {
-		switch (action) {
-		case SA_SET:
-		case SA_ADD:
-			ref_selection()[i]= current_selection;
-			break;
-		case SA_DEL:
-			ref_selection()[i] = 0;
-		}
+	if (begin >= end)
+		return;
+	if (type == ST_COMPONENT) {
+		for (Idx i = begin; i < end; ++i)
+			apply_action(i, part_of_selection);
+		return;
+	}
+	if (part_of_selection)
+		ref_point_selection().set_range(begin, end, action == SA_DEL ? 0 : current_selection);
+	else if (action == SA_SET)
+		ref_point_selection().replace_in_range(begin, end, current_selection, 0);
+}
+
+selection_tool::Box selection_tool::get_selection_box() const
+{
+	return Box(ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * select_box.get_min_pnt(), ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * select_box.get_max_pnt());
+}
+
+bool selection_tool::find_points_in_box(const Box& box, std::vector<Idx>& result, const Box* excluded_box_ptr)
+{
+	// octree indexes untransformed points
+	if (ref_pc().has_component_transformations() || ref_pc().get_nr_points() == 0)
+		return false;
+	octree_base* octree_ptr = ensure_octree_index();
+	if (!octree_ptr || octree_ptr->get_nr_indexed_points() != ref_pc().get_nr_points())
+		return false;
+	std::vector<octree_base::point_index_type> point_indices;
+	if (excluded_box_ptr)
+		octree_ptr->find_in_box_difference(box, *excluded_box_ptr, point_indices);
+	else
+		octree_ptr->find_in_box(box, point_indices);
+	result.assign(point_indices.begin(), point_indices.end());
+	return true;
+}
+
+bool selection_tool::find_points_in_polygon(std::vector<cgv::type::uint8_type>& inside)
+{
+	if (!view_projection_valid || select_polygon.size() < 3)
+		return false;
+	point_cloud& pc = ref_pc();
+	polygon_mask mask;
+	mask.rasterize(select_polygon, int(view_projection.width), int(view_projection.height));
+	inside.assign(pc.get_nr_points(), 0);
+	// octree indexes untransformed points
+	octree_base* octree_ptr = 0;
+	if (use_spatial_index && !pc.has_component_transformations() && pc.get_nr_points() > 0)
+		octree_ptr = ensure_octree_index();
+	if (octree_ptr && octree_ptr->get_nr_indexed_points() == pc.get_nr_points())
+		select_points_in_polygon(*octree_ptr, view_projection, mask, inside.data());
+	else
+		select_points_in_polygon(pc.get_nr_points(), [&pc](size_t i) { return pc.transformed_pnt(Idx(i)); }, view_projection, mask, inside.data());
+	return true;
+}
+
+void selection_tool::find_points_in_brush(Idx picked_index, std::vector<Idx>& result)
+{
+	result.clear();
+	point_cloud& pc = ref_pc();
+	// octree indexes untransformed points
+	bool transformed = pc.has_component_transformations();
+	Pnt center = pc.transformed_pnt(picked_index);
+	float radius = brush_radius * pc.box().get_extent().length();
+	if (brush_in_screen_space) {
+		if (!view_projection_valid)
+			return;
+		// convert pixel radius to world radius at the depth of the picked point
+		const lod_view& view = view_projection.view;
+		float w = view.mvp[3][0] * center[0] + view.mvp[3][1] * center[1] + view.mvp[3][2] * center[2] + view.mvp[3][3];
+		if (w <= 0 || view.pixel_scale <= 0)
+			return;
+		radius = brush_pixel_radius * w / view.pixel_scale;
+	}
+	octree_base* octree_ptr = transformed ? 0 : ensure_octree_index();
+	if (octree_ptr && octree_ptr->get_nr_indexed_points() == pc.get_nr_points()) {
+		std::vector<octree_base::point_index_type> point_indices;
+		octree_ptr->find_in_radius(center, radius, point_indices);
+		result.assign(point_indices.begin(), point_indices.end());
 	}
 	else {
-		switch (action) {
-		case SA_SET:
-			if (ref_selection()[i] == current_selection)
-				ref_selection()[i] = 0;
-			break;
-		}
+		float sqr_radius = radius * radius;
+		for (Idx i = 0; i < (Idx)pc.get_nr_points(); ++i)
+			if ((pc.transformed_pnt(i) - center).sqr_length() <= sqr_radius)
+				result.push_back(i);
+	}
+	if (pc.has_normals()) {
+		// keep only points facing the eye
+		Pnt eye = ref_view_ptr()->get_eye();
+		result.erase(std::remove_if(result.begin(), result.end(), [&](Idx i) {
+			Pnt nml = transformed ? pc.component_rotation(pc.component_index(i)).apply(pc.nml(i)) : pc.nml(i);
+			return dot(eye - pc.transformed_pnt(i), nml) < 0;
+		}), result.end());
+	}
+}
+
+void selection_tool::close_polygon()
+{
+	polygon_active = false;
+	if (select_polygon.size() < 3) {
+		select_polygon.clear();
+		post_redraw();
+		return;
+	}
+	perform_action();
+}
+
+void selection_tool::benchmark_box_selection()
+{
+	typedef std::chrono::steady_clock clock;
+	Box box = get_selection_box();
+	Cnt n = Cnt(ref_pc().get_nr_points());
+	std::vector<bool> brute_force_inside(n, false), indexed_inside(n, false);
+	auto start = clock::now();
+	for (Idx i = 0; i < (Idx)n; ++i)
+		brute_force_inside[i] = box.inside(ref_pc().transformed_pnt(i));
+	double brute_force_time = std::chrono::duration<double>(clock::now() - start).count();
+	std::vector<Idx> result;
+	start = clock::now();
+	if (!find_points_in_box(box, result)) {
+		std::cout << "indexed box selection needs the octree as spatial index and is not available for transformed components" << std::endl;
+		return;
 	}
+	double indexed_time = std::chrono::duration<double>(clock::now() - start).count();
+	for (Idx i : result)
+		indexed_inside[i] = true;
+	std::cout << "box selection of " << result.size() << " of " << n << " points: brute force " << brute_force_time << " sec, indexed " << indexed_time
+		<< " sec, speedup " << brute_force_time / indexed_time << ", selections " << (brute_force_inside == indexed_inside ? "identical" : "DIFFER") << std::endl;
 }
 
 void selection_tool::perform_action()
 {
 	Idx i;
 	Box box;
-	// check for incremental update
-	if (last_mode == mode && last_type == type && mode != SM_BOX) {
+	std::vector<Idx> box_points, left_points;
+	std::vector<cgv::type::uint8_type> inside;
+	// check for incremental update, where screen space selections depend on the view and are always recomputed
+	bool incremental = last_selection_valid && mode != SM_LASSO && mode != SM_POLYGON && last_mode == mode && last_type == type && last_action == action && last_current_selection == current_selection;
+	if (incremental && mode == SM_BOX) {
+		// only points in the symmetric difference of the last and the new box change
+		box = get_selection_box();
+		incremental = type == ST_POINT && use_spatial_index &&
+			find_points_in_box(last_select_box, left_points, &box) && find_points_in_box(box, box_points, &last_select_box);
+	}
+	if (incremental) {
 		switch (mode) {
 		case SM_SINGLE:
 			apply_action(last_select_index, false);
@@ -74,34 +214,52 @@ void selection_tool::perform_action()
 			last_select_index = select_index;
 			break;
 		case SM_RANGE:
-			for (i = last_select_range[0]; i <= last_select_range[1]; ++i)
-				apply_action(i, false);
-			for (i = select_range[0]; i <= select_range[1]; ++i)
-				apply_action(i, true);
+			apply_action_to_range(last_select_range[0], last_select_range[1] + 1, false);
+			apply_action_to_range(select_range[0], select_range[1] + 1, true);
 			last_select_range = select_range;
 			break;
+		case SM_BOX:
+			for (Idx pi : left_points)
+				apply_action(pi, false);
+			for (Idx pi : box_points)
+				apply_action(pi, true);
+			last_select_box = box;
+			break;
 		}
 	}
 	else {
 		Cnt nr = Cnt(type == ST_POINT ? ref_pc().get_nr_points() : ref_pc().get_nr_components());
 		switch (mode) {
 		case SM_SINGLE:
-			for (i = 0; i < (Idx)nr; ++i)
-				apply_action(i, i == select_index);
+			apply_action_to_range(0, select_index, false);
+			apply_action(select_index, true);
+			apply_action_to_range(select_index + 1, (Idx)nr, false);
 			last_select_index = select_index;
 			break;
 		case SM_RANGE:
-			for (i = 0; i < select_range[0]; ++i)
-				apply_action(i, false);
-			for (; i <= select_range[1]; ++i)
-				apply_action(i, true);
-			for (; i < (Idx)nr; ++i)
-				apply_action(i, false);
+			apply_action_to_range(0, select_range[0], false);
+			apply_action_to_range(select_range[0], select_range[1] + 1, true);
+			apply_action_to_range(select_range[1] + 1, (Idx)nr, false);
 			last_select_range = select_range;
 			break;
 		case SM_BOX :
-			box = Box(ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * select_box.get_min_pnt(), ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * select_box.get_max_pnt());
-			if (type == ST_POINT) {
+			box = get_selection_box();
+			if (use_spatial_index && find_points_in_box(box, box_points)) {
+				if (type == ST_POINT) {
+					// set action deselects all points outside of the box, which is equivalent to deselecting all before selecting the points inside
+					apply_action_to_range(0, (Idx)ref_pc().get_nr_points(), false);
+					for (Idx pi : box_points)
+						apply_action(pi, true);
+				}
+				else {
+					std::vector<bool> selected(ref_pc().get_nr_components(), false);
+					for (Idx pi : box_points)
+						selected[ref_pc().component_index(pi)] = true;
+					for (i = 0; i < (Idx)ref_pc().get_nr_components(); ++i)
+						apply_action(i, selected[i]);
+				}
+			}
+			else if (type == ST_POINT) {
 				for (i = 0; i < (Idx)ref_pc().get_nr_points(); ++i) 
 					apply_action(i, box.inside(ref_pc().transformed_pnt(i)));
 			}
@@ -113,9 +271,32 @@ void selection_tool::perform_action()
 				for (i = 0; i < (Idx)ref_pc().get_nr_components(); ++i)
 					apply_action(i, selected[i]);
 			}
+			last_select_box = box;
 			break;
+		case SM_LASSO:
+		case SM_POLYGON:
+		{
+			if (!find_points_in_polygon(inside))
+				break;
+			if (type == ST_POINT)
+				ref_point_selection().transform(0, inside.size(), [&](size_t pi, cgv::type::uint8_type s) { return get_new_selection(s, inside[pi] != 0); });
+			else {
+				std::vector<bool> selected(ref_pc().get_nr_components(), false);
+				for (i = 0; i < (Idx)inside.size(); ++i)
+					if (inside[i])
+						selected[ref_pc().component_index(i)] = true;
+				for (i = 0; i < (Idx)ref_pc().get_nr_components(); ++i)
+					apply_action(i, selected[i]);
+			}
+			break;
+		}
 		}
 	}
+	last_selection_valid = true;
+	last_type = type;
+	last_mode = mode;
+	last_action = action;
+	last_current_selection = current_selection;
 	viewer_ptr->on_selection_change_callback(type);
 	post_redraw();
 }
@@ -162,9 +343,50 @@ bool selection_tool::handle(cgv::gui::event& e)
 	if (e.get_kind() != cgv::gui::EID_MOUSE)
 		return false;
 	cgv::gui::mouse_event& me = (cgv::gui::mouse_event&) e;
+	if (mode == SM_LASSO || mode == SM_POLYGON) {
+		cgv::vec2 p(float(me.get_x()), float(me.get_y()));
+		switch (me.get_action()) {
+		case cgv::gui::MA_PRESS:
+			if (me.get_modifiers() != cgv::gui::EM_CTRL)
+				break;
+			if (me.get_button() == cgv::gui::MB_LEFT_BUTTON) {
+				// lasso restarts with each press while polygon collects one vertex per press
+				if (mode == SM_LASSO || !polygon_active)
+					select_polygon.clear();
+				polygon_active = true;
+				select_polygon.push_back(p);
+				post_redraw();
+				return true;
+			}
+			if (me.get_button() == cgv::gui::MB_RIGHT_BUTTON && mode == SM_POLYGON && polygon_active) {
+				close_polygon();
+				return true;
+			}
+			break;
+		case cgv::gui::MA_DRAG:
+			if (mode == SM_LASSO && polygon_active) {
+				if ((p - select_polygon.back()).length() >= 2.0f) {
+					select_polygon.push_back(p);
+					post_redraw();
+				}
+				return true;
+			}
+			break;
+		case cgv::gui::MA_RELEASE:
+			if (mode == SM_LASSO && polygon_active && me.get_button() == cgv::gui::MB_LEFT_BUTTON) {
+				close_polygon();
+				return true;
+			}
+			break;
+		default:
+			break;
+		}
+	}
 	if (me.get_action() == cgv::gui::MA_MOVE) {
-		if (me.get_modifiers() != cgv::gui::EM_SHIFT)
+		if (me.get_modifiers() != cgv::gui::EM_SHIFT) {
+			brush_stroke_active = false;
 			return false;
+		}
 		unsigned picked_index;
 		if (get_picked_point(me.get_x(), me.get_y(), picked_index)) {
 			if (ref_pc().has_normals()) {
@@ -172,8 +394,30 @@ bool selection_tool::handle(cgv::gui::event& e)
 				if (dot(eye - ref_pc().pnt(picked_index), ref_pc().nml(picked_index)) < 0)
 					return false;
 			}
-			ref_point_selection()[picked_index] = current_selection;
-			viewer_ptr->on_selection_change_callback(type);
+			std::vector<Idx> brush_points;
+			if (use_brush)
+				find_points_in_brush(picked_index, brush_points);
+			else
+				brush_points.push_back(picked_index);
+			bool changed = false;
+			for (Idx pi : brush_points) {
+				if (ref_point_selection().get(pi) != current_selection) {
+					ref_point_selection().set(pi, current_selection);
+					changed = true;
+				}
+			}
+			if (!changed)
+				return true;
+			last_selection_valid = false;
+			// selection colors are read when drawing, so the viewer needs to be informed only once per stroke and redraws are coalesced to one per frame
+			if (!brush_stroke_active) {
+				brush_stroke_active = true;
+				viewer_ptr->on_selection_change_callback(type);
+			}
+			if (!brush_redraw_pending) {
+				brush_redraw_pending = true;
+				post_redraw();
+			}
 		}
 		return true;
 	}
@@ -182,7 +426,7 @@ bool selection_tool::handle(cgv::gui::event& e)
 
 void selection_tool::stream_help(std::ostream& os)
 {
-	os << "selection tool: 1-3 set index, S-0-3 toggle show" << std::endl;
+	os << "selection tool: 1-3 set index, S-0-3 toggle show, Shift-Move paint with brush, Ctrl-LeftDrag lasso, Ctrl-LeftClick/Ctrl-RightClick add polygon vertex/close polygon" << std::endl;
 }
 
 bool selection_tool::self_reflect(cgv::reflect::reflection_handler& srh)
@@ -197,21 +441,49 @@ bool selection_tool::self_reflect(cgv::reflect::reflection_handler& srh)
 		srh.reflect_member("select_index", select_index) &&
 		srh.reflect_member("select_range", select_range) &&
 		srh.reflect_member("show_box", show_box) &&
+		srh.reflect_member("use_spatial_index", use_spatial_index) &&
+		srh.reflect_member("permute_in_place", permute_in_place_enabled) &&
+		srh.reflect_member("use_brush", use_brush) &&
+		srh.reflect_member("brush_in_screen_space", brush_in_screen_space) &&
+		srh.reflect_member("brush_radius", brush_radius) &&
+		srh.reflect_member("brush_pixel_radius", brush_pixel_radius) &&
 		srh.reflect_member("box_color", box_color) &&
 		srh.reflect_member("select_box", select_box);
 }
 
 void selection_tool::draw(cgv::render::context& ctx)
 {
-	if (!show_box || !select_box.is_valid())
+	view_projection.set(ctx.get_projection_matrix(), ctx.get_modelview_matrix(), float(ctx.get_width()), float(ctx.get_height()));
+	view_projection_valid = true;
+	brush_redraw_pending = false;
+	if (!show_box)
 		return;
-	viewer_ptr->draw_box(ctx, Box(ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * select_box.get_min_pnt(), ref_pc().box().get_min_pnt() + ref_pc().box().get_extent() * select_box.get_max_pnt()), box_color);
+	if (select_box.is_valid())
+		viewer_ptr->draw_box(ctx, get_selection_box(), box_color);
+	if ((mode == SM_LASSO || mode == SM_POLYGON) && !select_polygon.empty()) {
+		ctx.push_pixel_coords();
+		glPushAttrib(GL_ENABLE_BIT);
+		glDisable(GL_LIGHTING);
+		glDisable(GL_DEPTH_TEST);
+		cgv::media::color<float, cgv::media::RGB, cgv::media::OPACITY> c(box_color);
+		glColor4f(c[0], c[1], c[2], c[3]);
+		glBegin(polygon_active ? GL_LINE_STRIP : GL_LINE_LOOP);
+		for (const auto& p : select_polygon)
+			glVertex2f(p[0], p[1]);
+		glEnd();
+		glPopAttrib();
+		ctx.pop_pixel_coords();
+	}
 }
 
 void selection_tool::on_point_cloud_change_callback(PointCloudChangeEvent pcc_event)
 {
-	if ((pcc_event & PCC_POINTS_MASK) != 0)
+	if ((pcc_event & PCC_POINTS_MASK) != 0) {
 		reset_selection_box();
+		select_polygon.clear();
+		polygon_active = false;
+		last_selection_valid = false;
+	}
 }
 
 void selection_tool::on_set(void* member_ptr)
@@ -289,19 +561,24 @@ void selection_tool::on_set(void* member_ptr)
 void selection_tool::create_components()
 {
 	point_cloud& pc = ref_pc();
-	std::vector<Cnt> cnts(4, 0);
-	for (auto pi : ref_point_selection())
-		++cnts[pi];
+	size_t n = pc.get_nr_points();
+	// counts of the packed selection skip uniform blocks, such that a selection without points is rejected before sorting
+	const packed_selection& selection = ref_point_selection();
+	size_t class_counts[4];
+	selection.count_classes(class_counts);
+	std::vector<Cnt> cnts(class_counts, class_counts + 4);
 	Cnt nr = 0;
 	for (auto c : cnts)
 		if (c > 0)
 			++nr;
-	if (nr == 1) {
+	if (nr <= 1) {
 		cgv::gui::message("no points selected for component creation");
 		return;
 	}
-	// compute permutation
-
+	// stable counting sort of points by selection index
+	std::vector<Idx> perm;
+	std::vector<size_t> sorted_class_counts;
+	compute_counting_sort_permutation(n, 4, [&selection](size_t i) { return selection.get(i); }, perm, sorted_class_counts);
 	// create components and accumulate counts
 	pc.create_components();
 	pc.create_component_colors();
@@ -318,20 +595,30 @@ void selection_tool::create_components()
 		if (i > 0)
 			cnts[i] += cnts[i - 1];
 	}
-	// compute per selection first points index
-	std::vector<Cnt> fsts(4, 0);
-	for (i = 1; i < 4; ++i)
-		fsts[i] = cnts[i - 1];
-	
-	// compute component inidices and permutation
-	std::vector<Idx> perm(pc.get_nr_points());
-	for (i = 0; i < perm.size(); ++i) {
-		Idx si = ref_point_selection()[i];
-		Cnt new_i = fsts[si]++;
-		pc.component_index(new_i) = cis[si];
-		perm[i] = new_i;
+	// points of selection index i form range [cnts[i-1],cnts[i]) after sorting, where component indices are set directly
+	for (i = 0; i < 4; ++i) {
+		Cnt begin = i == 0 ? 0 : cnts[i - 1];
+		parallel_for(begin, cnts[i], [&](size_t b, size_t e) {
+			for (size_t pi = b; pi < e; ++pi)
+				pc.component_index(Idx(pi)) = cis[i];
+		});
 	}
-	pc.permute(perm, false);
+	// permute attributes one after another, such that at most one temporary array is allocated at a time
+	permute_array(&pc.pnt(0), n, perm, permute_in_place_enabled);
+	if (pc.has_normals())
+		permute_array(&pc.nml(0), n, perm, permute_in_place_enabled);
+	if (pc.has_colors())
+		permute_array(&pc.clr(0), n, perm, permute_in_place_enabled);
+	if (pc.has_texture_coordinates())
+		permute_array(&pc.texcrd(0), n, perm, permute_in_place_enabled);
+	if (pc.has_pixel_coordinates())
+		permute_array(&pc.pixcrd(0), n, perm, permute_in_place_enabled);
+	// sorted selection consists of one run per selection index
+	for (i = 0; i < 4; ++i)
+		ref_point_selection().set_range(i == 0 ? 0 : cnts[i - 1], cnts[i], cgv::type::uint8_type(i));
+	last_selection_valid = false;
+	// spatial indices and neighbor graph refer to the old point order
+	viewer_ptr->on_point_order_change(perm);
 }
 
 void selection_tool::config_gui()
@@ -355,13 +642,20 @@ void selection_tool::create_gui()
 	connect_copy(add_button("select")->click, cgv::signal::rebind(this, &selection_tool::perform_action));
 	add_member_control(this, "auto_select", auto_perform_action, "toggle");
 	add_member_control(this, "auto_mode", auto_select_mode, "toggle");
-	add_member_control(this, "mode", mode, "dropdown", "enums='single,range,box'");
+	add_member_control(this, "mode", mode, "dropdown", "enums='single,range,box,lasso,polygon'");
 	add_member_control(this, "current_selection", current_selection, "value_slider", "min=1;max=3");
 	add_member_control(this, "index", select_index, "value_slider", "min=0;ticks=true");
 	add_gui("range", select_range, "ascending", "components='<>';min_size=1;options='min=0;ticks=true'");
+	add_member_control(this, "use index", use_spatial_index, "toggle");
+	add_member_control(this, "brush", use_brush, "toggle");
+	add_member_control(this, "brush in pixels", brush_in_screen_space, "toggle");
+	add_member_control(this, "brush_radius", brush_radius, "value_slider", "min=0.0001;max=0.2;log=true;ticks=true");
+	add_member_control(this, "brush_pixel_radius", brush_pixel_radius, "value_slider", "min=1;max=100;ticks=true");
+	connect_copy(add_button("benchmark box selection")->click, cgv::signal::rebind(this, &selection_tool::benchmark_box_selection));
 	add_member_control(this, "show", show_box, "toggle");
 	add_gui("select_box", select_box, "", "order_by_coords=true;min_size=0.1;main_label='first';align_col=' ';align_row='%Y-=6\n%Y+=6';align_end='\n';gui_type='slider';options='min=0;max=1;w=60;ticks=true;step=0.001'");
 	add_member_control(this, "color", box_color);
+	add_member_control(this, "permute in place", permute_in_place_enabled, "toggle");
 	connect_copy(add_button("create components")->click, cgv::signal::rebind(this, &selection_tool::create_components));
 	config_gui();
 }
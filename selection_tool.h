@@ -1,6 +1,7 @@
 #pragma once
 
 #include "point_cloud_tool.h"
+#include "screen_selection.h"
 #include <cgv/math/fvec.h>
 
 #include "lib_begin.h"
@@ -12,7 +13,9 @@ public:
 	enum SelectMode {
 		SM_SINGLE,
 		SM_RANGE,
-		SM_BOX
+		SM_BOX,
+		SM_LASSO,
+		SM_POLYGON
 	};
 	enum SelectAction {
 		SA_SET,
@@ -20,10 +23,24 @@ public:
 		SA_DEL
 	};
 private:
+	/// state of the last performed action, which allows incremental updates as long as it is valid
+	bool last_selection_valid;
 	SelectType last_type;
 	SelectMode last_mode;
+	SelectAction last_action;
+	cgv::type::uint8_type last_current_selection;
 	Idx last_select_index;
 	index_range last_select_range;
+	Box last_select_box;
+	/// projection of the last drawn frame used to select points in screen space
+	screen_projection view_projection;
+	bool view_projection_valid;
+	/// whether the polygon is still being drawn with the mouse
+	bool polygon_active;
+	/// whether the selection has been changed by the current brush stroke, which is ended by a mouse move without shift
+	bool brush_stroke_active;
+	/// whether a redraw has been posted for a brush change and not yet been drawn
+	bool brush_redraw_pending;
 protected:
 	bool auto_perform_action;
 	bool auto_select_mode;
@@ -35,13 +52,40 @@ protected:
 	Idx select_index;
 	index_range select_range;
 	Box select_box;
+	/// answer box selections with a query on the octree shared with the viewer, which is not possible with component transformations
+	bool use_spatial_index;
+	/// paint all points within a radius around the picked point instead of only the picked point
+	bool use_brush;
+	/// measure brush radius in pixels instead of relative to the diagonal of the bounding box
+	bool brush_in_screen_space;
+	float brush_radius;
+	float brush_pixel_radius;
+	/// vertices of lasso or polygon in window coordinates
+	std::vector<cgv::vec2> select_polygon;
+	/// permute point attributes in create_components by following cycles instead of a parallel scatter into a temporary copy, which saves memory but runs sequentially
+	bool permute_in_place_enabled;
 	bool show_box;
 	Rgba box_color;
-	std::vector<cgv::type::uint8_type>& ref_selection() const;
+	/// return selection box in point coordinates
+	Box get_selection_box() const;
+	/// set result to the indices of the points inside of box and, if given, outside of excluded_box with an octree query and return false if points are transformed or the octree is not the spatial index of the viewer
+	bool find_points_in_box(const Box& box, std::vector<Idx>& result, const Box* excluded_box_ptr = 0);
+	/// set inside[i] to 1 for the points that project into the selection polygon in the last drawn view and to 0 otherwise and return false if no view or polygon is available
+	bool find_points_in_polygon(std::vector<cgv::type::uint8_type>& inside);
+	/// set result to the indices of the points within the brush around point picked_index
+	void find_points_in_brush(Idx picked_index, std::vector<Idx>& result);
+	/// finish lasso or polygon and perform action on it
+	void close_polygon();
 	void perform_action();
+	/// compare time and result of brute force and indexed box selection
+	void benchmark_box_selection();
 	void create_components();
 	void reset_selection_box();
+	/// return selection that action assigns to an element of selection s depending on whether it is part of the selection
+	cgv::type::uint8_type get_new_selection(cgv::type::uint8_type s, bool part_of_selection) const;
 	void apply_action(Idx i, bool part_of_selection);
+	/// apply action to all elements in [begin,end), which updates whole words of the packed point selection
+	void apply_action_to_range(Idx begin, Idx end, bool part_of_selection);
 	void config_gui();
 public:
 	selection_tool(point_cloud_viewer_ptr pcv_ptr);
@@ -0,0 +1,116 @@
+/// headless test of point_lod_octree::select_cut over synthetic points, which checks that cuts respect the point budget, grow monotonically with decreasing error threshold and cull nodes outside of the view frustum;
+/// build by compiling this file together with the octree headers, e.g. g++ -std=c++17 -I<cgv include dirs> -I.. lod_octree_test.cxx, and run without arguments, where a non zero exit code reports failed checks
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../lod_octree.h"
+
+namespace {
+
+/// minimal 4x4 matrix with the element access expected by lod_view::set
+struct matrix
+{
+	float m[4][4] = {};
+	float operator () (unsigned i, unsigned j) const { return m[i][j]; }
+};
+
+matrix perspective(float fovy_degrees, float z_near, float z_far)
+{
+	matrix P;
+	float f = 1.0f / std::tan(0.5f * fovy_degrees * 3.14159265f / 180.0f);
+	P.m[0][0] = f;
+	P.m[1][1] = f;
+	P.m[2][2] = (z_far + z_near) / (z_near - z_far);
+	P.m[2][3] = 2.0f * z_far * z_near / (z_near - z_far);
+	P.m[3][2] = -1.0f;
+	return P;
+}
+
+matrix translation(float x, float y, float z)
+{
+	matrix T;
+	for (unsigned i = 0; i < 4; ++i)
+		T.m[i][i] = 1.0f;
+	T.m[0][3] = x;
+	T.m[1][3] = y;
+	T.m[2][3] = z;
+	return T;
+}
+
+unsigned nr_failed_checks = 0;
+
+void check(bool condition, const char* message)
+{
+	if (!condition) {
+		std::cerr << "FAILED: " << message << std::endl;
+		++nr_failed_checks;
+	}
+}
+
+}
+
+int main()
+{
+	std::vector<cgv::vec3> points(200000);
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+	for (auto& p : points)
+		p = cgv::vec3(coordinate(generator), coordinate(generator), coordinate(generator));
+	point_octree octree;
+	octree.construct(points.data(), octree_base::point_index_type(points.size()), 64, true);
+	point_lod_octree lod;
+	lod.build(octree, 32);
+
+	// boxes of all nodes to test cut nodes against the frustum
+	std::vector<cgv::box3> boxes(octree.get_nr_nodes());
+	octree.visit_depth_first([&](const octree_base::node_ref& nr) { boxes[nr.node_index] = nr.box; return true; });
+	auto count_points = [&](const std::vector<octree_base::node_index_type>& cut) {
+		size_t n = 0;
+		for (auto ni : cut)
+			n += lod.get_nr_samples(ni);
+		return n;
+	};
+
+	matrix P = perspective(60.0f, 0.1f, 100.0f);
+	lod_view front_view, half_view, back_view;
+	front_view.set(P, translation(0, 0, -4), 1000.0f);
+	half_view.set(P, translation(-1.5f, 0, -2), 1000.0f);
+	back_view.set(P, translation(0, 0, 4), 1000.0f);
+	std::vector<octree_base::node_index_type> cut;
+
+	// budget: the cut never exceeds a budget that admits the root samples and reports its size
+	size_t root_samples = lod.get_nr_samples(octree.get_root_ref().node_index);
+	for (size_t budget : { root_samples, size_t(1000), size_t(10000), size_t(50000), points.size() }) {
+		size_t n = lod.select_cut(front_view, 0.0f, budget, cut);
+		check(n <= budget, "cut exceeds point budget");
+		check(n == count_points(cut), "returned number of points differs from the samples in the cut");
+	}
+	check(lod.select_cut(front_view, 0.0f, points.size(), cut) == points.size(), "unbounded cut of fully visible points does not reach the leaves");
+
+	// monotonicity: lowering the error threshold never removes points from the cut, with and without limiting budget
+	for (size_t budget : { size_t(20000), points.size() }) {
+		size_t previous_n = 0;
+		for (float max_screen_error = 256.0f; max_screen_error >= 0.25f; max_screen_error *= 0.5f) {
+			size_t n = lod.select_cut(front_view, max_screen_error, budget, cut);
+			check(n >= previous_n, "cut shrinks for smaller error threshold");
+			previous_n = n;
+		}
+	}
+
+	// culling: nothing is selected behind the eye and a partial view only keeps nodes that intersect the frustum
+	check(lod.select_cut(back_view, 0.0f, points.size(), cut) == 0 && cut.empty(), "points behind the eye are not culled");
+	size_t n_half = lod.select_cut(half_view, 0.0f, points.size(), cut);
+	bool all_visible = true;
+	for (auto ni : cut)
+		all_visible = all_visible && !half_view.is_culled(boxes[ni]);
+	check(all_visible, "cut contains node outside of the view frustum");
+	check(n_half > 0 && n_half < points.size(), "partial view does not cull part of the points");
+
+	if (nr_failed_checks > 0) {
+		std::cerr << nr_failed_checks << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}